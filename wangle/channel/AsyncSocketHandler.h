@@ -51,10 +51,12 @@ class AsyncSocketHandler
   }
 
   void attachReadCallback() {
-    socket_->setReadCB(socket_->good() ? this : nullptr);
+    reading_ = true;
+    socket_->setReadCB(socket_->good() && !paused_ ? this : nullptr);
   }
 
   void detachReadCallback() {
+    reading_ = false;
     if (socket_ && socket_->getReadCallback() == this) {
       socket_->setReadCB(nullptr);
     }
@@ -65,6 +67,24 @@ class AsyncSocketHandler
     }
   }
 
+  /**
+   * Stops reading from the socket, for handlers applying backpressure, until
+   * resumeReading().  Unlike detachReadCallback() the transport stays active.
+   */
+  void pauseReading() {
+    paused_ = true;
+    if (socket_ && socket_->getReadCallback() == this) {
+      socket_->setReadCB(nullptr);
+    }
+  }
+
+  void resumeReading() {
+    paused_ = false;
+    if (reading_) {
+      attachReadCallback();
+    }
+  }
+
   void attachEventBase(folly::EventBase* eventBase) {
     if (eventBase && !socket_->getEventBase()) {
       socket_->attachEventBase(eventBase);
@@ -210,6 +230,9 @@ class AsyncSocketHandler
   std::shared_ptr<folly::AsyncTransportWrapper> socket_{nullptr};
   bool firedInactive_{false};
   bool pipelineDeleted_{false};
+  // Whether the pipeline wants to read, and whether reading is paused
+  bool reading_{false};
+  bool paused_{false};
 };
 
 } // namespace wangle
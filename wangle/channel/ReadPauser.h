@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <wangle/channel/AsyncSocketHandler.h>
+
+namespace wangle {
+
+/**
+ * Stops and restarts reading from a pipeline's socket, for handlers that
+ * apply backpressure.  Pausing goes through the pipeline's
+ * AsyncSocketHandler, which stops reading so the kernel buffers fill up
+ * and the peer slows down, while the transport stays active; resuming
+ * reads again.  Pipelines without an AsyncSocketHandler are not paused.
+ *
+ * Call cancel() from transportInactive(), so the socket handler does not
+ * stay paused for a later transport.  Must be used from the transport's
+ * EventBase thread.
+ */
+class ReadPauser {
+ public:
+  template <class Context>
+  void pause(Context* ctx) {
+    if (handler_) {
+      return;
+    }
+    handler_ = ctx->getPipeline()->template getHandler<AsyncSocketHandler>();
+    if (handler_) {
+      handler_->pauseReading();
+    }
+  }
+
+  void resume() {
+    if (handler_) {
+      handler_->resumeReading();
+      handler_ = nullptr;
+    }
+  }
+
+  // The handler only reads again once its transport is active
+  void cancel() {
+    resume();
+  }
+
+  bool isPaused() const {
+    return handler_ != nullptr;
+  }
+
+ private:
+  AsyncSocketHandler* handler_{nullptr};
+};
+
+} // namespace wangle
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/Crc32cFrameDecoder.h>
+
+#include <folly/Conv.h>
+#include <folly/hash/Checksum.h>
+#include <folly/io/Cursor.h>
+
+using folly::IOBuf;
+using folly::IOBufQueue;
+
+namespace wangle {
+
+namespace {
+
+constexpr uint32_t kLengthFieldLength = 4;
+constexpr uint32_t kChecksumLength = 4;
+
+// Extends crc over length bytes of q starting at offset
+uint32_t checksum(const IOBufQueue& q,
+                  size_t offset,
+                  size_t length,
+                  uint32_t crc) {
+  const IOBuf* head = q.front();
+  const IOBuf* seg = head;
+  do {
+    size_t len = seg->length();
+    if (offset < len) {
+      size_t n = std::min(len - offset, length);
+      crc = folly::crc32c(seg->data() + offset, n, crc);
+      length -= n;
+      offset = 0;
+    } else {
+      offset -= len;
+    }
+    seg = seg->next();
+  } while (length > 0 && seg != head);
+  return crc;
+}
+
+} // namespace
+
+bool Crc32cFrameDecoder::decode(Context* ctx,
+                                IOBufQueue& buf,
+                                std::unique_ptr<IOBuf>& result,
+                                size_t& needed) {
+  if (!inFrame_) {
+    if (buf.chainLength() < kLengthFieldLength) {
+      needed = kLengthFieldLength - buf.chainLength();
+      return false;
+    }
+    folly::io::Cursor c(buf.front());
+    frameLength_ = c.readBE<uint32_t>();
+    if (frameLength_ > maxFrameLength_) {
+      buf.move();
+      ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+                               "Frame larger than " +
+                               folly::to<std::string>(maxFrameLength_)));
+      return false;
+    }
+    buf.trimStart(kLengthFieldLength);
+    inFrame_ = true;
+    checked_ = 0;
+    crc_ = ~0U;
+  }
+
+  // Checksum whatever part of the payload arrived since the last read
+  uint32_t available = std::min<uint64_t>(buf.chainLength(), frameLength_);
+  if (available > checked_) {
+    crc_ = checksum(buf, checked_, available - checked_, crc_);
+    checked_ = available;
+  }
+
+  uint64_t frameEnd = uint64_t(frameLength_) + kChecksumLength;
+  if (buf.chainLength() < frameEnd) {
+    needed = frameEnd - buf.chainLength();
+    return false;
+  }
+  inFrame_ = false;
+
+  folly::io::Cursor c(buf.front());
+  c.skip(frameLength_);
+  if (c.readBE<uint32_t>() != crc_) {
+    buf.trimStart(frameEnd);
+    ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+                             "Frame checksum mismatch"));
+    return false;
+  }
+
+  result = frameLength_ ? buf.split(frameLength_) : IOBuf::create(0);
+  buf.trimStart(kChecksumLength);
+  return true;
+}
+
+} // namespace wangle
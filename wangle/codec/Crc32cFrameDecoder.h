@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <wangle/codec/ByteToMessageDecoder.h>
+
+namespace wangle {
+
+/**
+ * A decoder for frames written by Crc32cFramePrepender: a 4 byte big endian
+ * payload length, the payload, and a 4 byte big endian CRC32C of the
+ * payload as computed by folly::crc32c (which uses the SSE4.2 crc32
+ * instruction when the CPU has it, and a software implementation
+ * otherwise).  Only the payload is passed on.
+ *
+ * The checksum is computed incrementally: payload bytes are checksummed as
+ * they arrive, so a large frame received over many reads is never rescanned
+ * and is ready to verify as soon as its trailer arrives.
+ *
+ * A frame whose checksum does not match is dropped and fires a read
+ * exception.  A frame longer than maxFrameLength discards the rest of the
+ * stream, since its length cannot be trusted either.
+ */
+class Crc32cFrameDecoder : public ByteToByteDecoder {
+ public:
+  explicit Crc32cFrameDecoder(uint32_t maxFrameLength = UINT_MAX)
+      : maxFrameLength_(maxFrameLength) {}
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              std::unique_ptr<folly::IOBuf>& result,
+              size_t& needed) override;
+
+ private:
+  uint32_t maxFrameLength_;
+
+  // The payload length of the frame being received, whose length field was
+  // already consumed, and how much of it has been checksummed so far
+  bool inFrame_{false};
+  uint32_t frameLength_{0};
+  uint32_t checked_{0};
+  uint32_t crc_{0};
+};
+
+} // namespace wangle
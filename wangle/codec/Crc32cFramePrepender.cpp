@@ -0,0 +1,73 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/Crc32cFramePrepender.h>
+
+#include <cstring>
+
+#include <folly/Bits.h>
+#include <folly/hash/Checksum.h>
+#include <folly/io/Cursor.h>
+
+using folly::Future;
+using folly::Unit;
+using folly::IOBuf;
+
+namespace wangle {
+
+Future<Unit> Crc32cFramePrepender::write(
+    Context* ctx, std::unique_ptr<IOBuf> buf) {
+  uint64_t length = buf->computeChainDataLength();
+  if (length > UINT32_MAX) {
+    throw std::runtime_error("length does not fit 4 bytes");
+  }
+
+  uint32_t crc = ~0U;
+  for (auto range : *buf) {
+    crc = folly::crc32c(range.data(), range.size(), crc);
+  }
+
+  // Write the length into the headroom and the checksum into the tailroom
+  // when there is room, e.g. in buffers from SizedMessageToByteEncoder
+  if (!buf->isSharedOne() && buf->headroom() >= 4) {
+    buf->prepend(4);
+    folly::io::RWPrivateCursor lc(buf.get());
+    lc.writeBE(uint32_t(length));
+  } else {
+    auto len = IOBuf::create(4);
+    len->append(4);
+    folly::io::RWPrivateCursor lc(len.get());
+    lc.writeBE(uint32_t(length));
+    len->prependChain(std::move(buf));
+    buf = std::move(len);
+  }
+
+  auto last = buf->prev();
+  if (!last->isSharedOne() && last->tailroom() >= 4) {
+    uint32_t be = folly::Endian::big(crc);
+    memcpy(last->writableTail(), &be, 4);
+    last->append(4);
+  } else {
+    auto trailer = IOBuf::create(4);
+    trailer->append(4);
+    folly::io::RWPrivateCursor tc(trailer.get());
+    tc.writeBE(crc);
+    buf->prependChain(std::move(trailer));
+  }
+  return ctx->fireWrite(std::move(buf));
+}
+
+} // namespace wangle
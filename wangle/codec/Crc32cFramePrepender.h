@@ -0,0 +1,37 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <wangle/channel/Handler.h>
+
+namespace wangle {
+
+/**
+ * Prepends a 4 byte big endian length and appends a 4 byte big endian
+ * CRC32C trailer to each write, for Crc32cFrameDecoder to verify.
+ *
+ * +--------+----------------+------------+
+ * | 0x000C | "HELLO, WORLD" | CRC32C     |
+ * +--------+----------------+------------+
+ */
+class Crc32cFramePrepender : public OutboundBytesToBytesHandler {
+ public:
+  folly::Future<folly::Unit> write(Context* ctx,
+                                   std::unique_ptr<folly::IOBuf> buf) override;
+};
+
+} // namespace wangle
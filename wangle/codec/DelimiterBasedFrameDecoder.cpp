@@ -0,0 +1,187 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/DelimiterBasedFrameDecoder.h>
+
+#include <cstring>
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+namespace wangle {
+
+using folly::io::Cursor;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+
+DelimiterBasedFrameDecoder::DelimiterBasedFrameDecoder(
+    std::vector<std::string> delimiters,
+    uint32_t maxFrameLength,
+    bool stripDelimiter)
+    : delimiters_(std::move(delimiters))
+    , maxFrameLength_(maxFrameLength)
+    , stripDelimiter_(stripDelimiter) {
+  CHECK(!delimiters_.empty());
+  for (const auto& delim : delimiters_) {
+    CHECK(!delim.empty());
+    if (firstBytes_.find(delim[0]) == std::string::npos) {
+      firstBytes_.push_back(delim[0]);
+    }
+  }
+}
+
+bool DelimiterBasedFrameDecoder::decode(Context* ctx,
+                                        IOBufQueue& buf,
+                                        std::unique_ptr<IOBuf>& result,
+                                        size_t& needed) {
+  size_t delimLength = 0;
+  int64_t frameLength = findDelimiter(buf, delimLength);
+
+  if (discarding_) {
+    if (frameLength < 0) {
+      // Everything before the scan position can't be part of a delimiter
+      buf.trimStart(scanned_);
+      scanned_ = 0;
+      return false;
+    }
+    buf.trimStart(frameLength + delimLength);
+    scanned_ = 0;
+    discarding_ = false;
+    return decode(ctx, buf, result, needed);
+  }
+
+  if (frameLength >= 0) {
+    scanned_ = 0;
+    if (frameLength > maxFrameLength_) {
+      buf.trimStart(frameLength + delimLength);
+      fail(ctx, folly::to<std::string>(frameLength));
+      return false;
+    }
+
+    if (stripDelimiter_) {
+      result = buf.split(frameLength);
+      buf.trimStart(delimLength);
+    } else {
+      result = buf.split(frameLength + delimLength);
+    }
+    return true;
+  }
+
+  if (scanned_ > maxFrameLength_) {
+    auto len = scanned_;
+    buf.trimStart(len);
+    scanned_ = 0;
+    discarding_ = true;
+    fail(ctx, "over " + folly::to<std::string>(len));
+  }
+  return false;
+}
+
+int64_t DelimiterBasedFrameDecoder::findDelimiter(IOBufQueue& buf,
+                                                  size_t& delimLength) {
+  if (scanned_ >= buf.chainLength()) {
+    return -1;
+  }
+
+  const IOBuf* head = buf.front();
+  const IOBuf* seg = head;
+  size_t base = 0;
+  do {
+    size_t len = seg->length();
+    if (base + len > scanned_) {
+      StringPiece data(reinterpret_cast<const char*>(seg->data()), len);
+      size_t pos = scanned_ - base;
+      while (pos < len) {
+        pos = firstBytes_.size() == 1
+          ? data.find(firstBytes_[0], pos)
+          : data.find_first_of(firstBytes_, pos);
+        if (pos == StringPiece::npos) {
+          break;
+        }
+
+        switch (matchDelimiter(buf, seg, pos, base + pos, delimLength)) {
+          case MatchResult::MATCH:
+            return base + pos;
+          case MatchResult::NEED_MORE:
+            // Resume from this candidate once more bytes arrive
+            scanned_ = base + pos;
+            return -1;
+          case MatchResult::NO_MATCH:
+            break;
+        }
+        pos++;
+      }
+      scanned_ = base + len;
+    }
+    base += len;
+    seg = seg->next();
+  } while (seg != head);
+
+  return -1;
+}
+
+DelimiterBasedFrameDecoder::MatchResult
+DelimiterBasedFrameDecoder::matchDelimiter(IOBufQueue& buf,
+                                           const IOBuf* seg,
+                                           size_t segOffset,
+                                           size_t offset,
+                                           size_t& delimLength) {
+  const size_t segRemaining = seg->length() - segOffset;
+  folly::Optional<Cursor> cursor;
+
+  for (const auto& delim : delimiters_) {
+    if (delim.size() <= segRemaining) {
+      // Fast path, the candidate is entirely inside this segment
+      if (std::memcmp(seg->data() + segOffset, delim.data(), delim.size()) ==
+          0) {
+        delimLength = delim.size();
+        return MatchResult::MATCH;
+      }
+      continue;
+    }
+
+    if (!cursor) {
+      cursor.emplace(buf.front());
+      cursor->skip(offset);
+    }
+    Cursor c(*cursor);
+    size_t i = 0;
+    while (i < delim.size() && !c.isAtEnd() &&
+           c.read<char>() == delim[i]) {
+      i++;
+    }
+    if (i == delim.size()) {
+      delimLength = delim.size();
+      return MatchResult::MATCH;
+    }
+    if (c.isAtEnd() && offset + i == buf.chainLength()) {
+      // Everything we have matches, the rest hasn't arrived yet
+      return MatchResult::NEED_MORE;
+    }
+  }
+
+  return MatchResult::NO_MATCH;
+}
+
+void DelimiterBasedFrameDecoder::fail(Context* ctx, std::string len) {
+  ctx->fireReadException(
+    folly::make_exception_wrapper<std::runtime_error>(
+      "frame length " + len +
+      " exceeds max " + folly::to<std::string>(maxFrameLength_)));
+}
+
+} // namespace wangle
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/io/Cursor.h>
+#include <wangle/codec/ByteToMessageDecoder.h>
+
+namespace wangle {
+
+/**
+ * A decoder that splits the received IOBufQueue by one or more
+ * delimiters.  It is particularly useful for protocols whose frames end
+ * with a NUL byte (STOMP) or a blank line ("\r\n\r\n").
+ *
+ * For example, with the delimiter "\0" the following stream:
+ *
+ * +----------------------+
+ * | ABC\0DEF\0GH | I\0   |
+ * +----------------------+
+ *
+ * decodes into three frames:
+ *
+ * +-----+-----+-----+
+ * | ABC | DEF | GHI |
+ * +-----+-----+-----+
+ *
+ * If more than one delimiter matches, the one that starts earliest in the
+ * stream wins; delimiters starting at the same position are tried in the
+ * order they were given.
+ *
+ * Candidate delimiter positions are located with folly's find / find_first_of
+ * on each IOBuf segment, which use memchr / SSE4.2 where available, and
+ * delimiters spanning segment boundaries are matched with a Cursor.  The
+ * number of bytes already scanned is remembered across calls, so a large
+ * frame arriving in many small reads is scanned only once.
+ */
+class DelimiterBasedFrameDecoder : public ByteToByteDecoder {
+ public:
+  explicit DelimiterBasedFrameDecoder(
+      std::vector<std::string> delimiters,
+      uint32_t maxFrameLength = UINT_MAX,
+      bool stripDelimiter = true);
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              std::unique_ptr<folly::IOBuf>& result,
+              size_t&) override;
+
+ private:
+  enum class MatchResult {
+    NO_MATCH,
+    MATCH,
+    NEED_MORE
+  };
+
+  int64_t findDelimiter(folly::IOBufQueue& buf, size_t& delimLength);
+
+  MatchResult matchDelimiter(folly::IOBufQueue& buf,
+                             const folly::IOBuf* seg,
+                             size_t segOffset,
+                             size_t offset,
+                             size_t& delimLength);
+
+  void fail(Context* ctx, std::string len);
+
+  std::vector<std::string> delimiters_;
+  std::string firstBytes_;
+  uint32_t maxFrameLength_;
+  bool stripDelimiter_;
+
+  bool discarding_{false};
+  // Bytes at the front of the queue known not to start a delimiter
+  size_t scanned_{0};
+};
+
+} // namespace wangle
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/EncoderBufferPool.h>
+
+#include <array>
+#include <cstdlib>
+#include <vector>
+
+using folly::IOBuf;
+
+namespace wangle {
+
+constexpr size_t EncoderBufferPool::kMinBlockSize;
+constexpr size_t EncoderBufferPool::kMaxBlockSize;
+constexpr size_t EncoderBufferPool::kMaxCachedBytes;
+
+namespace {
+
+// kMinBlockSize << kNumSizeClasses - 1 == kMaxBlockSize
+constexpr size_t kNumSizeClasses = 9;
+
+class BlockCache {
+ public:
+  ~BlockCache() {
+    trim();
+  }
+
+  void* get(size_t sizeClass) {
+    auto& blocks = blocks_[sizeClass];
+    if (blocks.empty()) {
+      return nullptr;
+    }
+    auto block = blocks.back();
+    blocks.pop_back();
+    return block;
+  }
+
+  bool put(size_t sizeClass, void* block) {
+    auto& blocks = blocks_[sizeClass];
+    if ((blocks.size() + 1) * blockSize(sizeClass) >
+        EncoderBufferPool::kMaxCachedBytes) {
+      return false;
+    }
+    blocks.push_back(block);
+    return true;
+  }
+
+  void trim() {
+    for (auto& blocks : blocks_) {
+      for (auto block : blocks) {
+        free(block);
+      }
+      blocks.clear();
+    }
+  }
+
+  static size_t blockSize(size_t sizeClass) {
+    return EncoderBufferPool::kMinBlockSize << sizeClass;
+  }
+
+ private:
+  std::array<std::vector<void*>, kNumSizeClasses> blocks_;
+};
+
+// Trivially destructible, so still usable by buffers freed from other
+// thread_local or static destructors once the cache itself is gone
+thread_local BlockCache* threadCache = nullptr;
+thread_local bool threadCacheDestroyed = false;
+
+class CacheOwner {
+ public:
+  CacheOwner() {
+    threadCache = &cache_;
+  }
+
+  ~CacheOwner() {
+    threadCache = nullptr;
+    threadCacheDestroyed = true;
+  }
+
+ private:
+  BlockCache cache_;
+};
+
+// The calling thread's cache, or nullptr once the thread is exiting
+BlockCache* getCache() {
+  if (!threadCache && !threadCacheDestroyed) {
+    static thread_local CacheOwner owner;
+  }
+  return threadCache;
+}
+
+void releaseBlock(void* block, void* userData) {
+  auto sizeClass = reinterpret_cast<uintptr_t>(userData);
+  auto cache = getCache();
+  if (!cache || !cache->put(sizeClass, block)) {
+    free(block);
+  }
+}
+
+} // namespace
+
+std::unique_ptr<IOBuf> EncoderBufferPool::allocate(size_t capacity,
+                                                   size_t headroom) {
+  size_t size = capacity + headroom;
+  if (size < kMinBlockSize || size > kMaxBlockSize) {
+    auto buf = IOBuf::create(size);
+    buf->advance(headroom);
+    return buf;
+  }
+
+  size_t sizeClass = 0;
+  while (BlockCache::blockSize(sizeClass) < size) {
+    sizeClass++;
+  }
+  auto cache = getCache();
+  auto block = cache ? cache->get(sizeClass) : nullptr;
+  if (!block) {
+    block = malloc(BlockCache::blockSize(sizeClass));
+    if (!block) {
+      throw std::bad_alloc();
+    }
+  }
+  // Allocates the IOBuf and its SharedInfo together, with the block
+  // supplying the data
+  auto buf = IOBuf::takeOwnership(block,
+                                  BlockCache::blockSize(sizeClass),
+                                  0,
+                                  releaseBlock,
+                                  reinterpret_cast<void*>(sizeClass));
+  buf->advance(headroom);
+  return buf;
+}
+
+void EncoderBufferPool::trim() {
+  if (auto cache = getCache()) {
+    cache->trim();
+  }
+}
+
+} // namespace wangle
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+namespace wangle {
+
+/**
+ * A per-thread cache of output buffers for encoders.
+ *
+ * Buffers come in power of two size classes from kMinBlockSize to
+ * kMaxBlockSize.  Freeing a buffer (normally once the transport has written
+ * it) returns its memory to the cache of the freeing thread, up to
+ * kMaxCachedBytes per size class.  A pooled buffer costs one allocation,
+ * for the IOBuf, where IOBuf::create() makes two at these sizes.  Smaller
+ * requests go to IOBuf::create(), which already allocates the IOBuf and
+ * its data together, and larger ones are not pooled either.
+ *
+ * Buffers may be freed on any thread, at any time: a thread that has no
+ * cache, or whose cache is already destroyed, frees the memory instead.
+ */
+class EncoderBufferPool {
+ public:
+  static constexpr size_t kMinBlockSize = 1024;
+  static constexpr size_t kMaxBlockSize = 256 * 1024;
+  static constexpr size_t kMaxCachedBytes = 256 * 1024;
+
+  /**
+   * Returns an empty buffer with at least headroom bytes of headroom and
+   * capacity bytes of tailroom.
+   */
+  static std::unique_ptr<folly::IOBuf> allocate(size_t capacity,
+                                                size_t headroom = 0);
+
+  /**
+   * Frees the blocks cached by the calling thread.
+   */
+  static void trim();
+};
+
+} // namespace wangle
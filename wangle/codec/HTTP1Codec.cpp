@@ -0,0 +1,571 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/HTTP1Codec.h>
+
+#include <cctype>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <wangle/codec/IOBufQueueScan.h>
+
+namespace wangle {
+
+using folly::io::Cursor;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+
+namespace {
+
+// Longest chunk-size line we accept, extensions included
+constexpr size_t kMaxChunkLineLength = 1024;
+
+constexpr StringPiece kLastChunk{"\r\n0\r\n\r\n"};
+
+bool equalsIgnoreCase(StringPiece a, StringPiece b) {
+  return a.size() == b.size() &&
+    std::equal(a.begin(), a.end(), b.begin(), folly::AsciiCaseInsensitive());
+}
+
+// Whether the last transfer coding applied is "chunked"
+bool isChunked(StringPiece transferEncoding) {
+  auto pos = transferEncoding.rfind(',');
+  if (pos != StringPiece::npos) {
+    transferEncoding.advance(pos + 1);
+  }
+  return equalsIgnoreCase(folly::trimWhitespace(transferEncoding), "chunked");
+}
+
+bool hasToken(StringPiece value, StringPiece token) {
+  while (!value.empty()) {
+    auto pos = value.find(',');
+    auto item = value.subpiece(0, pos);
+    if (equalsIgnoreCase(folly::trimWhitespace(item), token)) {
+      return true;
+    }
+    value.advance(pos == StringPiece::npos ? value.size() : pos + 1);
+  }
+  return false;
+}
+
+bool parseVersion(StringPiece version, uint8_t& major, uint8_t& minor) {
+  if (version.size() != 8 || !version.startsWith("HTTP/") ||
+      !isdigit(version[5]) || version[6] != '.' || !isdigit(version[7])) {
+    return false;
+  }
+  major = version[5] - '0';
+  minor = version[7] - '0';
+  return true;
+}
+
+char byteAt(IOBufQueue& q, size_t offset) {
+  Cursor c(q.front());
+  c.skip(offset);
+  return c.read<char>();
+}
+
+} // namespace
+
+folly::Optional<StringPiece> HTTPMessage::getHeader(StringPiece name) const {
+  for (const auto& header : headers_) {
+    if (equalsIgnoreCase(header.first, name)) {
+      return header.second;
+    }
+  }
+  return folly::none;
+}
+
+bool HTTPMessage::isKeepAlive() const {
+  auto connection = getHeader("Connection");
+  if (connection) {
+    if (hasToken(*connection, "close")) {
+      return false;
+    }
+    if (hasToken(*connection, "keep-alive")) {
+      return true;
+    }
+  }
+  return versionMajor_ > 1 || (versionMajor_ == 1 && versionMinor_ >= 1);
+}
+
+HTTP1Codec::HTTP1Codec(Direction direction,
+                       size_t maxHeaderSize,
+                       uint64_t maxBodySize)
+    : direction_(direction)
+    , maxHeaderSize_(maxHeaderSize)
+    , maxBodySize_(maxBodySize) {}
+
+void HTTP1Codec::read(Context* ctx, IOBufQueue& q) {
+  bool progress = true;
+  while (progress) {
+    switch (state_) {
+      case State::HEADERS:
+        progress = parseHeaders(ctx, q);
+        break;
+      case State::BODY:
+      case State::CHUNK_DATA: {
+        progress = parseBody(q);
+        if (progress) {
+          if (state_ == State::BODY) {
+            finishMessage(ctx);
+          } else {
+            state_ = State::CHUNK_DATA_END;
+          }
+        }
+        break;
+      }
+      case State::BODY_UNTIL_EOF:
+        if (!q.empty()) {
+          bodyLength_ += q.chainLength();
+          body_.append(q.move());
+          if (bodyLength_ > maxBodySize_) {
+            fail(ctx, q, "Body too large");
+          }
+        }
+        progress = false;
+        break;
+      case State::CHUNK_SIZE:
+        progress = parseChunkSize(ctx, q);
+        break;
+      case State::CHUNK_DATA_END:
+        progress = parseChunkDataEnd(ctx, q);
+        break;
+      case State::TRAILERS:
+        progress = parseTrailers(ctx, q);
+        break;
+      case State::ERROR:
+        q.move();
+        progress = false;
+        break;
+    }
+  }
+}
+
+void HTTP1Codec::readEOF(Context* ctx) {
+  if (state_ == State::BODY_UNTIL_EOF) {
+    finishMessage(ctx);
+  } else if (state_ != State::HEADERS && state_ != State::ERROR) {
+    state_ = State::ERROR;
+    ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+                             "EOF in the middle of a message"));
+  }
+  ctx->fireReadEOF();
+}
+
+folly::Future<folly::Unit> HTTP1Codec::write(Context* ctx, HTTPMessage msg) {
+  if (direction_ == Direction::SERVER &&
+      (msg.statusCode_ < 100 || msg.statusCode_ > 999)) {
+    return folly::makeFuture<folly::Unit>(
+      folly::make_exception_wrapper<std::runtime_error>(
+        folly::to<std::string>("Invalid status code ", msg.statusCode_)));
+  }
+  if (direction_ == Direction::CLIENT) {
+    headRequests_.push_back(msg.getMethod() == "HEAD");
+  }
+  return ctx->fireWrite(serialize(msg));
+}
+
+int64_t HTTP1Codec::findNewline(IOBufQueue& q) {
+  return scanForByte(q, '\n', scanned_);
+}
+
+bool HTTP1Codec::parseHeaders(Context* ctx, IOBufQueue& q) {
+  while (true) {
+    auto eol = findNewline(q);
+    if (eol < 0) {
+      if (q.chainLength() > maxHeaderSize_) {
+        fail(ctx, q, "Header block too large");
+      }
+      return false;
+    }
+
+    size_t lineLength = eol - lineStart_;
+    bool emptyLine = lineLength == 0 ||
+      (lineLength == 1 && byteAt(q, lineStart_) == '\r');
+    bool firstLine = lineStart_ == 0;
+    lineStart_ = scanned_ = eol + 1;
+
+    if (lineStart_ > maxHeaderSize_) {
+      fail(ctx, q, "Header block too large");
+      return false;
+    }
+    if (!emptyLine) {
+      continue;
+    }
+    if (firstLine) {
+      // Empty lines before the start line are allowed and ignored
+      q.trimStart(lineStart_);
+      lineStart_ = scanned_ = 0;
+      continue;
+    }
+    break;
+  }
+
+  auto block = q.split(lineStart_);
+  lineStart_ = scanned_ = 0;
+  block->coalesce();
+
+  StringPiece data(reinterpret_cast<const char*>(block->data()),
+                   block->length());
+  msg_.headerBlock_ = std::move(block);
+
+  bool startLine = true;
+  while (!data.empty()) {
+    auto pos = data.find('\n');
+    auto line = data.subpiece(0, pos);
+    data.advance(pos + 1);
+    if (!line.empty() && line.back() == '\r') {
+      line.subtract(1);
+    }
+    if (line.empty()) {
+      break;
+    }
+
+    bool ok = startLine ? parseStartLine(line) : parseHeaderLine(line);
+    if (!ok) {
+      fail(ctx, q, "Malformed header line: " + line.str());
+      return false;
+    }
+    startLine = false;
+  }
+
+  return startBody(ctx, q);
+}
+
+bool HTTP1Codec::parseStartLine(StringPiece line) {
+  auto sp = line.find(' ');
+  if (sp == StringPiece::npos) {
+    return false;
+  }
+  auto first = line.subpiece(0, sp);
+  auto rest = line.subpiece(sp + 1);
+
+  if (direction_ == Direction::SERVER) {
+    // METHOD SP request-target SP HTTP-version
+    auto sp2 = rest.rfind(' ');
+    if (sp2 == StringPiece::npos || first.empty() || sp2 == 0) {
+      return false;
+    }
+    msg_.method_ = first;
+    msg_.url_ = rest.subpiece(0, sp2);
+    return parseVersion(
+      rest.subpiece(sp2 + 1), msg_.versionMajor_, msg_.versionMinor_);
+  }
+
+  // HTTP-version SP status-code SP reason-phrase
+  if (!parseVersion(first, msg_.versionMajor_, msg_.versionMinor_) ||
+      rest.size() < 3 || !isdigit(rest[0]) || !isdigit(rest[1]) ||
+      !isdigit(rest[2])) {
+    return false;
+  }
+  msg_.statusCode_ =
+    (rest[0] - '0') * 100 + (rest[1] - '0') * 10 + (rest[2] - '0');
+  if (rest.size() > 3) {
+    if (rest[3] != ' ') {
+      return false;
+    }
+    msg_.statusMessage_ = rest.subpiece(4);
+  }
+  return true;
+}
+
+bool HTTP1Codec::parseHeaderLine(StringPiece line) {
+  // obsolete line folding is not supported
+  if (line.front() == ' ' || line.front() == '\t') {
+    return false;
+  }
+  auto colon = line.find(':');
+  if (colon == StringPiece::npos || colon == 0 ||
+      line[colon - 1] == ' ' || line[colon - 1] == '\t') {
+    return false;
+  }
+  msg_.headers_.emplace_back(
+    line.subpiece(0, colon), folly::trimWhitespace(line.subpiece(colon + 1)));
+  return true;
+}
+
+bool HTTP1Codec::startBody(Context* ctx, IOBufQueue& q) {
+  if (direction_ == Direction::CLIENT) {
+    auto code = msg_.statusCode_;
+    if (code >= 100 && code < 200) {
+      // Interim response, the final one follows
+      msg_ = HTTPMessage();
+      return true;
+    }
+
+    bool headRequest = false;
+    if (!headRequests_.empty()) {
+      headRequest = headRequests_.front();
+      headRequests_.pop_front();
+    }
+    if (headRequest || code == 204 || code == 304) {
+      finishMessage(ctx);
+      return true;
+    }
+  }
+
+  auto transferEncoding = msg_.getHeader("Transfer-Encoding");
+  if (transferEncoding) {
+    if (isChunked(*transferEncoding)) {
+      state_ = State::CHUNK_SIZE;
+      return true;
+    }
+    if (direction_ == Direction::SERVER) {
+      fail(ctx, q, "Unsupported Transfer-Encoding");
+      return false;
+    }
+    state_ = State::BODY_UNTIL_EOF;
+    return true;
+  }
+
+  auto contentLength = msg_.getHeader("Content-Length");
+  if (contentLength) {
+    auto length = folly::tryTo<uint64_t>(*contentLength);
+    if (!length.hasValue()) {
+      fail(ctx, q, "Invalid Content-Length");
+      return false;
+    }
+    if (length.value() > maxBodySize_) {
+      fail(ctx, q, "Body too large");
+      return false;
+    }
+    remaining_ = length.value();
+    if (remaining_ == 0) {
+      finishMessage(ctx);
+    } else {
+      state_ = State::BODY;
+    }
+    return true;
+  }
+
+  if (direction_ == Direction::CLIENT) {
+    state_ = State::BODY_UNTIL_EOF;
+  } else {
+    finishMessage(ctx);
+  }
+  return true;
+}
+
+bool HTTP1Codec::parseBody(IOBufQueue& q) {
+  if (q.empty()) {
+    return false;
+  }
+  auto length = std::min<uint64_t>(remaining_, q.chainLength());
+  body_.append(q.split(length));
+  remaining_ -= length;
+  return remaining_ == 0;
+}
+
+bool HTTP1Codec::parseChunkSize(Context* ctx, IOBufQueue& q) {
+  auto eol = findNewline(q);
+  if (eol < 0) {
+    if (q.chainLength() > kMaxChunkLineLength) {
+      fail(ctx, q, "Chunk size line too long");
+    }
+    return false;
+  }
+
+  auto lineBuf = q.split(eol + 1);
+  lineStart_ = scanned_ = 0;
+  lineBuf->coalesce();
+  StringPiece line(reinterpret_cast<const char*>(lineBuf->data()),
+                   lineBuf->length());
+  line = folly::trimWhitespace(line.subpiece(0, line.find(';')));
+
+  uint64_t size = 0;
+  if (line.empty() || line.size() > 15) {
+    fail(ctx, q, "Invalid chunk size");
+    return false;
+  }
+  for (auto c : line) {
+    uint8_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      fail(ctx, q, "Invalid chunk size");
+      return false;
+    }
+    size = (size << 4) | digit;
+  }
+
+  if (size == 0) {
+    state_ = State::TRAILERS;
+    return true;
+  }
+
+  bodyLength_ += size;
+  if (bodyLength_ > maxBodySize_) {
+    fail(ctx, q, "Body too large");
+    return false;
+  }
+  remaining_ = size;
+  state_ = State::CHUNK_DATA;
+  return true;
+}
+
+bool HTTP1Codec::parseChunkDataEnd(Context* ctx, IOBufQueue& q) {
+  if (q.empty()) {
+    return false;
+  }
+  auto c = byteAt(q, 0);
+  if (c == '\r') {
+    if (q.chainLength() < 2) {
+      return false;
+    }
+    c = byteAt(q, 1);
+    q.trimStart(1);
+  }
+  if (c != '\n') {
+    fail(ctx, q, "Missing CRLF after chunk data");
+    return false;
+  }
+  q.trimStart(1);
+  state_ = State::CHUNK_SIZE;
+  return true;
+}
+
+bool HTTP1Codec::parseTrailers(Context* ctx, IOBufQueue& q) {
+  // Trailer fields are consumed but not exposed
+  while (true) {
+    auto eol = findNewline(q);
+    if (eol < 0) {
+      if (q.chainLength() > maxHeaderSize_) {
+        fail(ctx, q, "Trailer too large");
+      }
+      return false;
+    }
+    bool emptyLine = eol == 0 || (eol == 1 && byteAt(q, 0) == '\r');
+    q.trimStart(eol + 1);
+    lineStart_ = scanned_ = 0;
+    if (emptyLine) {
+      finishMessage(ctx);
+      return true;
+    }
+  }
+}
+
+void HTTP1Codec::finishMessage(Context* ctx) {
+  if (!body_.empty()) {
+    msg_.body_ = body_.move();
+  }
+  bodyLength_ = 0;
+  remaining_ = 0;
+  state_ = State::HEADERS;
+
+  auto msg = std::move(msg_);
+  msg_ = HTTPMessage();
+  ctx->fireRead(std::move(msg));
+}
+
+void HTTP1Codec::fail(Context* ctx, IOBufQueue& q, const std::string& error) {
+  state_ = State::ERROR;
+  q.move();
+  body_.move();
+  msg_ = HTTPMessage();
+  ctx->fireReadException(
+    folly::make_exception_wrapper<std::runtime_error>(error));
+}
+
+std::unique_ptr<IOBuf> HTTP1Codec::serialize(HTTPMessage& msg) {
+  auto body = msg.moveBody();
+  uint64_t bodyLength = body ? body->computeChainDataLength() : 0;
+
+  auto transferEncoding = msg.getHeader("Transfer-Encoding");
+  bool chunked = transferEncoding && isChunked(*transferEncoding);
+  bool addLength = !transferEncoding && !msg.getHeader("Content-Length");
+  if (direction_ == Direction::SERVER) {
+    auto code = msg.statusCode_;
+    DCHECK(code >= 100 && code <= 999);
+    addLength = addLength && code >= 200 && code != 204 && code != 304;
+  } else {
+    addLength = addLength && bodyLength > 0;
+  }
+
+  auto head = IOBuf::create(256);
+  folly::io::Appender app(head.get(), 256);
+  auto push = [&](StringPiece s) {
+    app.push(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+  };
+  auto pushVersion = [&] {
+    push("HTTP/");
+    app.write<uint8_t>('0' + msg.versionMajor_);
+    app.write<uint8_t>('.');
+    app.write<uint8_t>('0' + msg.versionMinor_);
+  };
+
+  if (direction_ == Direction::SERVER) {
+    auto code = msg.statusCode_;
+    pushVersion();
+    app.write<uint8_t>(' ');
+    app.write<uint8_t>('0' + code / 100);
+    app.write<uint8_t>('0' + code / 10 % 10);
+    app.write<uint8_t>('0' + code % 10);
+    app.write<uint8_t>(' ');
+    push(msg.statusMessage_);
+  } else {
+    push(msg.method_);
+    app.write<uint8_t>(' ');
+    push(msg.url_);
+    app.write<uint8_t>(' ');
+    pushVersion();
+  }
+  push("\r\n");
+
+  for (const auto& header : msg.headers_) {
+    push(header.first);
+    push(": ");
+    push(header.second);
+    push("\r\n");
+  }
+
+  char digits[20];
+  if (addLength) {
+    push("Content-Length: ");
+    push(StringPiece(digits, folly::uint64ToBufferUnsafe(bodyLength, digits)));
+    push("\r\n");
+  }
+  push("\r\n");
+
+  if (chunked) {
+    if (bodyLength > 0) {
+      size_t n = 0;
+      auto v = bodyLength;
+      do {
+        digits[sizeof(digits) - ++n] = "0123456789abcdef"[v & 0xf];
+        v >>= 4;
+      } while (v);
+      push(StringPiece(digits + sizeof(digits) - n, n));
+      push("\r\n");
+      head->prependChain(std::move(body));
+      head->prependChain(IOBuf::wrapBuffer(kLastChunk.data(),
+                                           kLastChunk.size()));
+    } else {
+      push("0\r\n\r\n");
+    }
+  } else if (body) {
+    head->prependChain(std::move(body));
+  }
+
+  return head;
+}
+
+} // namespace wangle
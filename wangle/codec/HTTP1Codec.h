@@ -0,0 +1,234 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <wangle/channel/Handler.h>
+
+namespace wangle {
+
+/**
+ * An HTTP/1.x request or response.
+ *
+ * Messages produced by HTTP1Codec do not own copies of their start line or
+ * headers: every StringPiece points into the header block IOBuf the message
+ * was parsed from, which the message keeps alive.  Messages built by hand
+ * copy whatever is passed to the setters into storage owned by the message,
+ * so the StringPieces stay valid for the life of the message either way.
+ *
+ * The body is an IOBuf chain of slices of the read buffer; chunked bodies
+ * are reassembled by chaining the chunks, not by copying them.
+ */
+class HTTPMessage {
+ public:
+  typedef std::pair<folly::StringPiece, folly::StringPiece> Header;
+
+  HTTPMessage() = default;
+  HTTPMessage(HTTPMessage&&) = default;
+  HTTPMessage& operator=(HTTPMessage&&) = default;
+
+  // Requests
+  folly::StringPiece getMethod() const {
+    return method_;
+  }
+  void setMethod(folly::StringPiece method) {
+    method_ = own(method);
+  }
+  folly::StringPiece getURL() const {
+    return url_;
+  }
+  void setURL(folly::StringPiece url) {
+    url_ = own(url);
+  }
+
+  // Responses
+  uint16_t getStatusCode() const {
+    return statusCode_;
+  }
+  folly::StringPiece getStatusMessage() const {
+    return statusMessage_;
+  }
+  void setStatus(uint16_t code, folly::StringPiece message) {
+    statusCode_ = code;
+    statusMessage_ = own(message);
+  }
+
+  std::pair<uint8_t, uint8_t> getHTTPVersion() const {
+    return std::make_pair(versionMajor_, versionMinor_);
+  }
+  void setHTTPVersion(uint8_t major, uint8_t minor) {
+    versionMajor_ = major;
+    versionMinor_ = minor;
+  }
+
+  const std::vector<Header>& getHeaders() const {
+    return headers_;
+  }
+
+  /**
+   * Returns the value of the first header called name, compared case
+   * insensitively.
+   */
+  folly::Optional<folly::StringPiece> getHeader(folly::StringPiece name) const;
+
+  void addHeader(folly::StringPiece name, folly::StringPiece value) {
+    headers_.emplace_back(own(name), own(value));
+  }
+
+  const folly::IOBuf* getBody() const {
+    return body_.get();
+  }
+  std::unique_ptr<folly::IOBuf> moveBody() {
+    return std::move(body_);
+  }
+  void setBody(std::unique_ptr<folly::IOBuf> body) {
+    body_ = std::move(body);
+  }
+
+  /**
+   * Whether the connection may be reused after this message, following the
+   * HTTP/1.0 and HTTP/1.1 defaults and the Connection header.
+   */
+  bool isKeepAlive() const;
+
+ private:
+  friend class HTTP1Codec;
+
+  folly::StringPiece own(folly::StringPiece s) {
+    // deque never relocates its elements, so earlier pieces stay valid
+    storage_.emplace_back(s.data(), s.size());
+    return storage_.back();
+  }
+
+  folly::StringPiece method_;
+  folly::StringPiece url_;
+  uint16_t statusCode_{0};
+  folly::StringPiece statusMessage_;
+  uint8_t versionMajor_{1};
+  uint8_t versionMinor_{1};
+  std::vector<Header> headers_;
+  std::unique_ptr<folly::IOBuf> body_;
+
+  std::unique_ptr<folly::IOBuf> headerBlock_;
+  std::deque<std::string> storage_;
+};
+
+/**
+ * An HTTP/1.1 codec converting a byte pipeline to HTTPMessages.
+ *
+ * A SERVER codec parses requests and serializes responses, a CLIENT codec
+ * serializes requests and parses responses.  Both sides support pipelining:
+ * every complete message in the read buffer is fired in order, and a CLIENT
+ * codec remembers which outstanding requests were HEAD so it knows which
+ * responses carry no body.  Use PipelinedServerDispatcher /
+ * PipelinedClientDispatcher on top to keep requests and responses paired.
+ *
+ * The header block is located by scanning each IOBuf segment for '\n' and
+ * remembering how far it got, then split off the read queue and parsed in
+ * place; it is only copied if it spans more than one segment.  Bodies
+ * (Content-Length, chunked, or until EOF for responses) are split off the
+ * queue without copying.
+ *
+ * Interim 1xx responses are skipped, and protocol upgrades are not
+ * supported.  Malformed input fires a read exception and discards the rest
+ * of the stream.
+ */
+class HTTP1Codec : public Handler<folly::IOBufQueue&, HTTPMessage,
+                                  HTTPMessage, std::unique_ptr<folly::IOBuf>> {
+ public:
+  typedef typename Handler<folly::IOBufQueue&, HTTPMessage,
+                           HTTPMessage, std::unique_ptr<folly::IOBuf>>::Context
+    Context;
+
+  enum class Direction {
+    SERVER,
+    CLIENT
+  };
+
+  explicit HTTP1Codec(Direction direction,
+                      size_t maxHeaderSize = 64 * 1024,
+                      uint64_t maxBodySize = UINT32_MAX);
+
+  void read(Context* ctx, folly::IOBufQueue& q) override;
+
+  void readEOF(Context* ctx) override;
+
+  /**
+   * Responses without a three digit status code, such as a default
+   * constructed HTTPMessage, fail the write without sending anything.
+   */
+  folly::Future<folly::Unit> write(Context* ctx, HTTPMessage msg) override;
+
+ private:
+  enum class State {
+    HEADERS,
+    BODY,
+    BODY_UNTIL_EOF,
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_DATA_END,
+    TRAILERS,
+    ERROR
+  };
+
+  // Each returns false if more bytes are needed
+  bool parseHeaders(Context* ctx, folly::IOBufQueue& q);
+  bool parseBody(folly::IOBufQueue& q);
+  bool parseChunkSize(Context* ctx, folly::IOBufQueue& q);
+  bool parseChunkDataEnd(Context* ctx, folly::IOBufQueue& q);
+  bool parseTrailers(Context* ctx, folly::IOBufQueue& q);
+
+  bool parseStartLine(folly::StringPiece line);
+  bool parseHeaderLine(folly::StringPiece line);
+  bool startBody(Context* ctx, folly::IOBufQueue& q);
+
+  /**
+   * Finds the next '\n' in q at or after scanned_, remembering progress in
+   * scanned_.  Returns its offset, or -1 if there is none yet.
+   */
+  int64_t findNewline(folly::IOBufQueue& q);
+
+  void finishMessage(Context* ctx);
+  void fail(Context* ctx, folly::IOBufQueue& q, const std::string& error);
+
+  std::unique_ptr<folly::IOBuf> serialize(HTTPMessage& msg);
+
+  Direction direction_;
+  size_t maxHeaderSize_;
+  uint64_t maxBodySize_;
+
+  State state_{State::HEADERS};
+  HTTPMessage msg_;
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  uint64_t bodyLength_{0};
+  uint64_t remaining_{0};
+
+  // Header / chunk line scanning progress
+  size_t scanned_{0};
+  size_t lineStart_{0};
+
+  // CLIENT: for each request in flight, whether it was a HEAD request
+  std::deque<bool> headRequests_;
+};
+
+} // namespace wangle
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include <folly/io/IOBufQueue.h>
+
+namespace wangle {
+
+/**
+ * Returns the offset of the first occurrence of byte in q at or after offset
+ * scanned, or -1 if there is none.  On failure scanned is advanced to the end
+ * of q, so a decoder that keeps it between reads never rescans bytes.  Each
+ * segment is searched with memchr.
+ */
+inline int64_t scanForByte(const folly::IOBufQueue& q,
+                           uint8_t byte,
+                           size_t& scanned) {
+  if (scanned >= q.chainLength()) {
+    return -1;
+  }
+
+  const folly::IOBuf* head = q.front();
+  const folly::IOBuf* seg = head;
+  size_t base = 0;
+  do {
+    size_t len = seg->length();
+    if (base + len > scanned) {
+      size_t pos = scanned - base;
+      auto found = static_cast<const uint8_t*>(
+        memchr(seg->data() + pos, byte, len - pos));
+      if (found) {
+        return base + (found - seg->data());
+      }
+      scanned = base + len;
+    }
+    base += len;
+    seg = seg->next();
+  } while (seg != head);
+
+  return -1;
+}
+
+} // namespace wangle
@@ -16,11 +16,15 @@
 
 #include <wangle/codec/LengthFieldBasedFrameDecoder.h>
 
+#include <folly/Varint.h>
+
 using folly::IOBuf;
 using folly::IOBufQueue;
 
 namespace wangle {
 
+constexpr uint32_t LengthFieldBasedFrameDecoder::kVarintLengthField;
+
 LengthFieldBasedFrameDecoder::LengthFieldBasedFrameDecoder(
   uint32_t lengthFieldLength,
   uint32_t maxFrameLength,
@@ -48,13 +52,39 @@ bool LengthFieldBasedFrameDecoder::decode(Context* ctx,
     return false;
   }
 
+  if (lengthFieldLength_ == kVarintLengthField) {
+    uint64_t frameLength;
+    int varintLength =
+      getVarintFrameLength(buf, lengthFieldOffset_, frameLength);
+    if (varintLength == 0) {
+      return false;
+    }
+    if (varintLength < 0) {
+      // There is no way to find the next frame boundary, drop what we have.
+      buf.move();
+      ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
+                               "Malformed varint length field"));
+      return false;
+    }
+    return decodeFrame(
+      ctx, buf, result, frameLength, lengthFieldOffset_ + varintLength);
+  }
+
   uint64_t frameLength = getUnadjustedFrameLength(
     buf, lengthFieldOffset_, lengthFieldLength_, networkByteOrder_);
 
-  frameLength += lengthAdjustment_ + lengthFieldEndOffset_;
+  return decodeFrame(ctx, buf, result, frameLength, lengthFieldEndOffset_);
+}
+
+bool LengthFieldBasedFrameDecoder::decodeFrame(Context* ctx,
+                                               IOBufQueue& buf,
+                                               std::unique_ptr<IOBuf>& result,
+                                               uint64_t frameLength,
+                                               uint32_t lengthFieldEndOffset) {
+  frameLength += lengthAdjustment_ + lengthFieldEndOffset;
 
-  if (frameLength < lengthFieldEndOffset_) {
-    buf.trimStart(lengthFieldEndOffset_);
+  if (frameLength < lengthFieldEndOffset) {
+    buf.trimStart(lengthFieldEndOffset);
     ctx->fireReadException(folly::make_exception_wrapper<std::runtime_error>(
                              "Frame too small"));
     return false;
@@ -130,5 +160,29 @@ uint64_t LengthFieldBasedFrameDecoder::getUnadjustedFrameLength(
   return frameLength;
 }
 
+int LengthFieldBasedFrameDecoder::getVarintFrameLength(
+  IOBufQueue& buf, uint32_t offset, uint64_t& frameLength) {
+  if (buf.chainLength() <= offset) {
+    return 0;
+  }
+
+  folly::io::Cursor c(buf.front());
+  c.skip(offset);
+
+  frameLength = 0;
+  for (size_t i = 0; i < folly::kMaxVarintLength64; i++) {
+    if (c.isAtEnd()) {
+      return 0;
+    }
+    auto b = c.read<uint8_t>();
+    frameLength |= static_cast<uint64_t>(b & 0x7f) << (7 * i);
+    if (!(b & 0x80)) {
+      return i + 1;
+    }
+  }
+
+  return -1;
+}
+
 
 } // namespace wangle
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <type_traits>
+
 #include <folly/io/Cursor.h>
 #include <wangle/codec/ByteToMessageDecoder.h>
 
@@ -178,10 +180,22 @@ namespace wangle {
  * | 0xCA | 0x0010 | 0xFE | "HELLO, WORLD" |      | 0xFE | "HELLO, WORLD" |
  * +------+--------+------+----------------+      +------+----------------+
  *
+ * Varint length field
+ *
+ * Passing kVarintLengthField as lengthFieldLength decodes the length as a
+ * base-128 varint (the protobuf / LEB128 encoding), which takes between 1 and
+ * 10 bytes on the wire.  networkByteOrder is ignored in this mode, and
+ * lengthFieldEndOffset is computed per frame from the number of bytes the
+ * varint actually used, so initialBytesToStrip should normally be left at 0
+ * unless the varint size is known up front.
+ *
  * @see LengthFieldPrepender
+ * @see StaticLengthFieldBasedFrameDecoder
  */
 class LengthFieldBasedFrameDecoder : public ByteToByteDecoder {
  public:
+  static constexpr uint32_t kVarintLengthField = 0;
+
   explicit LengthFieldBasedFrameDecoder(uint32_t lengthFieldLength = 4,
                                         uint32_t maxFrameLength = UINT_MAX,
                                         uint32_t lengthFieldOffset = 0,
@@ -194,10 +208,17 @@ class LengthFieldBasedFrameDecoder : public ByteToByteDecoder {
               std::unique_ptr<folly::IOBuf>& result,
               size_t&) override;
 
- private:
-
-  uint64_t getUnadjustedFrameLength(
-    folly::IOBufQueue& buf, int offset, int length, bool networkByteOrder);
+ protected:
+  /**
+   * Validate the frame described by frameLength (as read from the wire) and
+   * split it off the front of buf once it is complete.  Shared by every
+   * length field flavor so they enforce the same limits and errors.
+   */
+  bool decodeFrame(Context* ctx,
+                   folly::IOBufQueue& buf,
+                   std::unique_ptr<folly::IOBuf>& result,
+                   uint64_t frameLength,
+                   uint32_t lengthFieldEndOffset);
 
   uint32_t lengthFieldLength_;
   uint32_t maxFrameLength_;
@@ -207,6 +228,73 @@ class LengthFieldBasedFrameDecoder : public ByteToByteDecoder {
   bool networkByteOrder_;
 
   uint32_t lengthFieldEndOffset_;
+
+ private:
+  uint64_t getUnadjustedFrameLength(
+    folly::IOBufQueue& buf, int offset, int length, bool networkByteOrder);
+
+  /**
+   * Read a varint length field at offset.  Returns the number of bytes the
+   * field occupies, 0 if buf does not hold the whole field yet, or -1 if the
+   * field is longer than a 64-bit varint can be.
+   */
+  int getVarintFrameLength(
+    folly::IOBufQueue& buf, uint32_t offset, uint64_t& frameLength);
+};
+
+/**
+ * A LengthFieldBasedFrameDecoder whose length field width and byte order are
+ * fixed at compile time.  The length is read with a single typed load instead
+ * of going through the per-frame switch on lengthFieldLength, which is
+ * measurable for streams of small frames.
+ *
+ * StaticLengthFieldBasedFrameDecoder<4> is equivalent to the default
+ * LengthFieldBasedFrameDecoder().
+ */
+template <uint32_t LengthFieldLength, bool NetworkByteOrder = true>
+class StaticLengthFieldBasedFrameDecoder final
+    : public LengthFieldBasedFrameDecoder {
+  static_assert(LengthFieldLength == 1 || LengthFieldLength == 2 ||
+                LengthFieldLength == 4 || LengthFieldLength == 8,
+                "lengthFieldLength must be 1, 2, 4 or 8");
+
+  using LengthType = typename std::conditional<
+      LengthFieldLength == 1, uint8_t, typename std::conditional<
+      LengthFieldLength == 2, uint16_t, typename std::conditional<
+      LengthFieldLength == 4, uint32_t, uint64_t>::type>::type>::type;
+
+ public:
+  explicit StaticLengthFieldBasedFrameDecoder(
+      uint32_t maxFrameLength = UINT_MAX,
+      uint32_t lengthFieldOffset = 0,
+      int32_t lengthAdjustment = 0,
+      uint32_t initialBytesToStrip = LengthFieldLength)
+      : LengthFieldBasedFrameDecoder(LengthFieldLength,
+                                     maxFrameLength,
+                                     lengthFieldOffset,
+                                     lengthAdjustment,
+                                     initialBytesToStrip,
+                                     NetworkByteOrder) {}
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              std::unique_ptr<folly::IOBuf>& result,
+              size_t&) override {
+    if (buf.chainLength() < lengthFieldEndOffset_) {
+      return false;
+    }
+
+    folly::io::Cursor c(buf.front());
+    c.skip(lengthFieldOffset_);
+    uint64_t frameLength;
+    if (NetworkByteOrder) {
+      frameLength = c.readBE<LengthType>();
+    } else {
+      frameLength = c.readLE<LengthType>();
+    }
+
+    return decodeFrame(ctx, buf, result, frameLength, lengthFieldEndOffset_);
+  }
 };
 
 } // namespace wangle
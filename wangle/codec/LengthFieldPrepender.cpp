@@ -16,12 +16,38 @@
 
 #include <wangle/codec/LengthFieldPrepender.h>
 
+#include <cstring>
+
+#include <folly/Varint.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+
 using folly::Future;
 using folly::Unit;
 using folly::IOBuf;
 
 namespace wangle {
 
+namespace {
+
+/**
+ * Makes room for a headerLength byte header in front of buf: in buf's
+ * headroom when it has enough (e.g. buffers from SizedMessageToByteEncoder),
+ * in which case nullptr is returned, otherwise in a new buffer to chain buf
+ * to.
+ */
+std::unique_ptr<IOBuf> prependableHeader(std::unique_ptr<IOBuf>& buf,
+                                         size_t headerLength) {
+  if (!buf->isSharedOne() && buf->headroom() >= headerLength) {
+    buf->prepend(headerLength);
+    return nullptr;
+  }
+  auto header = IOBuf::create(headerLength);
+  header->append(headerLength);
+  return header;
+}
+
+} // namespace
+
 LengthFieldPrepender::LengthFieldPrepender(
     int lengthFieldLength,
     int lengthAdjustment,
@@ -34,7 +60,12 @@ LengthFieldPrepender::LengthFieldPrepender(
     CHECK(lengthFieldLength == 1 ||
           lengthFieldLength == 2 ||
           lengthFieldLength == 4 ||
-          lengthFieldLength == 8 );
+          lengthFieldLength == 8 ||
+          lengthFieldLength ==
+            LengthFieldBasedFrameDecoder::kVarintLengthField);
+    CHECK(lengthFieldLength !=
+            LengthFieldBasedFrameDecoder::kVarintLengthField ||
+          !lengthIncludesLengthField);
   }
 
 Future<Unit> LengthFieldPrepender::write(
@@ -48,9 +79,23 @@ Future<Unit> LengthFieldPrepender::write(
     throw std::runtime_error("Length field < 0");
   }
 
-  auto len = IOBuf::create(lengthFieldLength_);
-  len->append(lengthFieldLength_);
-  folly::io::RWPrivateCursor c(len.get());
+  if (lengthFieldLength_ ==
+      LengthFieldBasedFrameDecoder::kVarintLengthField) {
+    uint8_t varint[folly::kMaxVarintLength64];
+    size_t varintLength = folly::encodeVarint(length, varint);
+    auto len = prependableHeader(buf, varintLength);
+    memcpy(len ? len->writableData() : buf->writableData(),
+           varint,
+           varintLength);
+    if (len) {
+      len->prependChain(std::move(buf));
+      buf = std::move(len);
+    }
+    return ctx->fireWrite(std::move(buf));
+  }
+
+  auto len = prependableHeader(buf, lengthFieldLength_);
+  folly::io::RWPrivateCursor c(len ? len.get() : buf.get());
 
   switch (lengthFieldLength_) {
     case 1: {
@@ -96,8 +141,11 @@ Future<Unit> LengthFieldPrepender::write(
     }
   }
 
-  len->prependChain(std::move(buf));
-  return ctx->fireWrite(std::move(len));
+  if (len) {
+    len->prependChain(std::move(buf));
+    buf = std::move(len);
+  }
+  return ctx->fireWrite(std::move(buf));
 }
 
 
@@ -46,6 +46,11 @@ namespace wangle {
  * + 0x000E | "HELLO, WORLD" |
  * +--------+----------------+
  *
+ * Passing LengthFieldBasedFrameDecoder::kVarintLengthField as
+ * lengthFieldLength writes the length as a base-128 varint instead, matching
+ * a LengthFieldBasedFrameDecoder configured the same way.  Since the size of
+ * a varint depends on its value, lengthIncludesLengthField is not supported
+ * in this mode.
  */
 class LengthFieldPrepender : public OutboundBytesToBytesHandler {
  public:
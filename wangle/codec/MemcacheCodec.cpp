@@ -0,0 +1,339 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/MemcacheCodec.h>
+
+#include <cstring>
+
+#include <folly/Bits.h>
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <wangle/codec/IOBufQueueScan.h>
+
+namespace wangle {
+
+using folly::io::Cursor;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+
+constexpr uint32_t MemcacheBinaryDecoder::kHeaderLength;
+constexpr size_t MemcacheBinaryEncoder::kDefaultHeadroom;
+
+namespace {
+
+// Values up to this size are copied behind a freshly allocated header
+// rather than chained, which would cost an extra IOBuf per message
+constexpr size_t kMaxInlineValueLength = 512;
+
+constexpr StringPiece kCRLF{"\r\n"};
+
+template <class Context>
+void failDecode(Context* ctx, IOBufQueue& buf, const std::string& error) {
+  buf.move();
+  ctx->fireReadException(
+    folly::make_exception_wrapper<std::runtime_error>(error));
+}
+
+size_t length(const std::unique_ptr<IOBuf>& buf) {
+  return buf ? buf->computeChainDataLength() : 0;
+}
+
+template <class T>
+uint8_t* putBE(uint8_t* p, T value) {
+  value = folly::Endian::big(value);
+  memcpy(p, &value, sizeof(T));
+  return p + sizeof(T);
+}
+
+uint8_t* putChain(uint8_t* p, const std::unique_ptr<IOBuf>& buf) {
+  if (buf) {
+    for (auto range : *buf) {
+      memcpy(p, range.data(), range.size());
+      p += range.size();
+    }
+  }
+  return p;
+}
+
+void appendTrailer(IOBuf& buf, StringPiece trailer) {
+  if (trailer.empty()) {
+    return;
+  }
+  auto last = buf.prev();
+  if (!last->isSharedOne() && last->tailroom() >= trailer.size()) {
+    memcpy(last->writableTail(), trailer.data(), trailer.size());
+    last->append(trailer.size());
+  } else {
+    buf.prependChain(IOBuf::wrapBuffer(trailer.data(), trailer.size()));
+  }
+}
+
+/**
+ * Returns headerLength bytes filled in by writeHeader, followed by body and
+ * trailer.  The header goes into body's headroom when there is enough.
+ */
+template <class WriteHeader>
+std::unique_ptr<IOBuf> prependHeader(std::unique_ptr<IOBuf> body,
+                                     size_t headerLength,
+                                     StringPiece trailer,
+                                     WriteHeader&& writeHeader) {
+  if (body && !body->isChained() && !body->isSharedOne() &&
+      body->headroom() >= headerLength) {
+    body->prepend(headerLength);
+    writeHeader(body->writableData());
+    appendTrailer(*body, trailer);
+    return body;
+  }
+
+  size_t bodyLength = length(body);
+  if (bodyLength <= kMaxInlineValueLength) {
+    auto out = IOBuf::create(headerLength + bodyLength + trailer.size());
+    writeHeader(out->writableData());
+    auto p = putChain(out->writableData() + headerLength, body);
+    memcpy(p, trailer.data(), trailer.size());
+    out->append(headerLength + bodyLength + trailer.size());
+    return out;
+  }
+
+  auto out = IOBuf::create(headerLength);
+  writeHeader(out->writableData());
+  out->append(headerLength);
+  out->prependChain(std::move(body));
+  appendTrailer(*out, trailer);
+  return out;
+}
+
+} // namespace
+
+bool MemcacheBinaryDecoder::decode(Context* ctx,
+                                   IOBufQueue& buf,
+                                   MemcacheBinaryMessage& result,
+                                   size_t& needed) {
+  if (buf.chainLength() < kHeaderLength) {
+    needed = kHeaderLength - buf.chainLength();
+    return false;
+  }
+
+  Cursor c(buf.front());
+  auto magic = c.read<uint8_t>();
+  if (magic != uint8_t(MemcacheBinaryMessage::Magic::REQUEST) &&
+      magic != uint8_t(MemcacheBinaryMessage::Magic::RESPONSE)) {
+    failDecode(ctx, buf, "Invalid magic byte");
+    return false;
+  }
+  auto opcode = c.read<uint8_t>();
+  auto keyLength = c.readBE<uint16_t>();
+  auto extrasLength = c.read<uint8_t>();
+  auto dataType = c.read<uint8_t>();
+  auto status = c.readBE<uint16_t>();
+  auto bodyLength = c.readBE<uint32_t>();
+
+  if (bodyLength > maxBodyLength_) {
+    failDecode(ctx, buf, "Body too long");
+    return false;
+  }
+  if (uint32_t(keyLength) + extrasLength > bodyLength) {
+    failDecode(ctx, buf, "Key and extras longer than body");
+    return false;
+  }
+
+  uint64_t frameLength = uint64_t(kHeaderLength) + bodyLength;
+  if (buf.chainLength() < frameLength) {
+    needed = frameLength - buf.chainLength();
+    return false;
+  }
+
+  result.magic = static_cast<MemcacheBinaryMessage::Magic>(magic);
+  result.opcode = static_cast<MemcacheBinaryMessage::Opcode>(opcode);
+  result.dataType = dataType;
+  result.status = status;
+  result.opaque = c.readBE<uint32_t>();
+  result.cas = c.readBE<uint64_t>();
+
+  buf.trimStart(kHeaderLength);
+  if (extrasLength) {
+    result.extras = buf.split(extrasLength);
+  }
+  if (keyLength) {
+    result.key = buf.split(keyLength);
+  }
+  uint32_t valueLength = bodyLength - keyLength - extrasLength;
+  if (valueLength) {
+    result.value = buf.split(valueLength);
+  }
+  return true;
+}
+
+std::unique_ptr<IOBuf> MemcacheBinaryEncoder::createValue(size_t capacity,
+                                                          size_t headroom) {
+  auto buf = IOBuf::create(headroom + capacity);
+  buf->advance(headroom);
+  return buf;
+}
+
+std::unique_ptr<IOBuf> MemcacheBinaryEncoder::encode(
+    MemcacheBinaryMessage& msg) {
+  size_t extrasLength = length(msg.extras);
+  size_t keyLength = length(msg.key);
+  size_t valueLength = length(msg.value);
+  if (extrasLength > UINT8_MAX) {
+    throw std::runtime_error("Extras too long");
+  }
+  if (keyLength > UINT16_MAX) {
+    throw std::runtime_error("Key too long");
+  }
+  uint64_t bodyLength = extrasLength + keyLength + valueLength;
+  if (bodyLength > UINT32_MAX) {
+    throw std::runtime_error("Body too long");
+  }
+
+  size_t headerLength =
+    MemcacheBinaryDecoder::kHeaderLength + extrasLength + keyLength;
+  return prependHeader(
+    std::move(msg.value), headerLength, StringPiece(), [&](uint8_t* p) {
+      *p++ = uint8_t(msg.magic);
+      *p++ = uint8_t(msg.opcode);
+      p = putBE<uint16_t>(p, keyLength);
+      *p++ = extrasLength;
+      *p++ = msg.dataType;
+      p = putBE<uint16_t>(p, msg.status);
+      p = putBE<uint32_t>(p, bodyLength);
+      p = putBE<uint32_t>(p, msg.opaque);
+      p = putBE<uint64_t>(p, msg.cas);
+      p = putChain(p, msg.extras);
+      putChain(p, msg.key);
+    });
+}
+
+bool MemcacheMetaDecoder::decode(Context* ctx,
+                                 IOBufQueue& buf,
+                                 MemcacheMetaMessage& result,
+                                 size_t& needed) {
+  if (valueLength_ < 0) {
+    auto eol = scanForByte(buf, '\n', scanned_);
+    if (eol < 0) {
+      if (buf.chainLength() > maxLineLength_) {
+        fail(ctx, buf, "Line too long");
+      }
+      return false;
+    }
+    if (static_cast<size_t>(eol) >= maxLineLength_) {
+      fail(ctx, buf, "Line too long");
+      return false;
+    }
+
+    auto line = buf.split(eol + 1);
+    scanned_ = 0;
+    line->coalesce();
+    if (line->length() < 2 || line->data()[line->length() - 2] != '\r') {
+      fail(ctx, buf, "Malformed line");
+      return false;
+    }
+    line->trimEnd(2);
+
+    std::vector<StringPiece> tokens;
+    folly::split(' ',
+                 StringPiece(reinterpret_cast<const char*>(line->data()),
+                             line->length()),
+                 tokens,
+                 true);
+    if (tokens.empty()) {
+      fail(ctx, buf, "Empty line");
+      return false;
+    }
+
+    MemcacheMetaMessage msg;
+    msg.command = tokens[0];
+    size_t next = 1;
+    if (MemcacheMetaMessage::hasKey(msg.command)) {
+      if (tokens.size() <= next) {
+        fail(ctx, buf, "Missing key");
+        return false;
+      }
+      msg.key = tokens[next++];
+    }
+    if (MemcacheMetaMessage::hasValue(msg.command)) {
+      if (tokens.size() <= next) {
+        fail(ctx, buf, "Missing data length");
+        return false;
+      }
+      auto length = folly::tryTo<uint32_t>(tokens[next++]);
+      if (!length.hasValue() || length.value() > maxValueLength_) {
+        fail(ctx, buf, "Invalid data length");
+        return false;
+      }
+      valueLength_ = length.value();
+    }
+    msg.flags.assign(tokens.begin() + next, tokens.end());
+    msg.line = std::move(line);
+
+    if (valueLength_ < 0) {
+      result = std::move(msg);
+      return true;
+    }
+    pending_ = std::move(msg);
+  }
+
+  uint64_t length = valueLength_;
+  if (buf.chainLength() < length + 2) {
+    needed = length + 2 - buf.chainLength();
+    return false;
+  }
+  pending_.value = length ? buf.split(length) : IOBuf::create(0);
+  Cursor c(buf.front());
+  if (c.read<char>() != '\r' || c.read<char>() != '\n') {
+    fail(ctx, buf, "Missing CRLF after data block");
+    return false;
+  }
+  buf.trimStart(2);
+  valueLength_ = -1;
+  result = std::move(pending_);
+  pending_ = MemcacheMetaMessage();
+  return true;
+}
+
+void MemcacheMetaDecoder::fail(Context* ctx, IOBufQueue& buf,
+                               const std::string& error) {
+  pending_ = MemcacheMetaMessage();
+  valueLength_ = -1;
+  scanned_ = 0;
+  failDecode(ctx, buf, error);
+}
+
+std::unique_ptr<IOBuf> MemcacheMetaEncoder::encode(MemcacheMetaMessage& msg) {
+  std::string line = msg.command.str();
+  if (MemcacheMetaMessage::hasKey(msg.command)) {
+    folly::toAppend(' ', msg.key, &line);
+  }
+  bool hasValue = MemcacheMetaMessage::hasValue(msg.command);
+  if (hasValue) {
+    folly::toAppend(' ', length(msg.value), &line);
+  }
+  for (auto flag : msg.flags) {
+    folly::toAppend(' ', flag, &line);
+  }
+  line.append(kCRLF.data(), kCRLF.size());
+
+  return prependHeader(
+    std::move(msg.value),
+    line.size(),
+    hasValue ? kCRLF : StringPiece(),
+    [&](uint8_t* p) { memcpy(p, line.data(), line.size()); });
+}
+
+} // namespace wangle
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <folly/Range.h>
+#include <wangle/codec/ByteToMessageDecoder.h>
+#include <wangle/codec/MessageToByteEncoder.h>
+
+namespace wangle {
+
+/**
+ * A memcache binary protocol packet.
+ *
+ * extras, key and value are null when the packet has none.  Packets
+ * decoded by MemcacheBinaryDecoder reference the read buffer there instead
+ * of copying it.
+ */
+struct MemcacheBinaryMessage {
+  enum class Magic : uint8_t {
+    REQUEST = 0x80,
+    RESPONSE = 0x81
+  };
+
+  enum class Opcode : uint8_t {
+    GET = 0x00,
+    SET = 0x01,
+    ADD = 0x02,
+    REPLACE = 0x03,
+    DELETE = 0x04,
+    INCREMENT = 0x05,
+    DECREMENT = 0x06,
+    QUIT = 0x07,
+    FLUSH = 0x08,
+    GETQ = 0x09,
+    NOOP = 0x0a,
+    VERSION = 0x0b,
+    GETK = 0x0c,
+    GETKQ = 0x0d,
+    APPEND = 0x0e,
+    PREPEND = 0x0f,
+    TOUCH = 0x1c,
+    GAT = 0x1d
+  };
+
+  enum class Status : uint16_t {
+    NO_ERROR = 0x0000,
+    KEY_NOT_FOUND = 0x0001,
+    KEY_EXISTS = 0x0002,
+    VALUE_TOO_LARGE = 0x0003,
+    INVALID_ARGUMENTS = 0x0004,
+    ITEM_NOT_STORED = 0x0005,
+    NON_NUMERIC_VALUE = 0x0006,
+    UNKNOWN_COMMAND = 0x0081,
+    OUT_OF_MEMORY = 0x0082
+  };
+
+  Magic magic{Magic::REQUEST};
+  Opcode opcode{Opcode::GET};
+  uint8_t dataType{0};
+  // The vbucket id in requests, a Status in responses
+  uint16_t status{0};
+  uint32_t opaque{0};
+  uint64_t cas{0};
+  std::unique_ptr<folly::IOBuf> extras;
+  std::unique_ptr<folly::IOBuf> key;
+  std::unique_ptr<folly::IOBuf> value;
+};
+
+/**
+ * Decodes memcache binary protocol packets.
+ *
+ * Works like a LengthFieldBasedFrameDecoder reading the total body length
+ * at offset 8 of the fixed 24 byte header, except that the body is split
+ * further into extras, key and value slices of the read buffer, so values
+ * are never copied.  Invalid magic bytes or lengths fire a read exception
+ * and discard the rest of the buffer.
+ */
+class MemcacheBinaryDecoder
+    : public ByteToMessageDecoder<MemcacheBinaryMessage> {
+ public:
+  static constexpr uint32_t kHeaderLength = 24;
+
+  explicit MemcacheBinaryDecoder(uint32_t maxBodyLength = 64 * 1024 * 1024)
+      : maxBodyLength_(maxBodyLength) {}
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              MemcacheBinaryMessage& result,
+              size_t& needed) override;
+
+ private:
+  uint32_t maxBodyLength_;
+};
+
+/**
+ * Encodes memcache binary protocol packets.
+ *
+ * If the value is a single unshared IOBuf with enough headroom, the header,
+ * extras and key are written into that headroom and the value buffer is
+ * sent as is.  Otherwise small values are copied behind a freshly
+ * allocated header and large ones are chained to it.  Allocate values with
+ * createValue() to take the first path.
+ */
+class MemcacheBinaryEncoder
+    : public MessageToByteEncoder<MemcacheBinaryMessage> {
+ public:
+  /**
+   * Room for the header, the 8 bytes of extras a SET carries and a key of
+   * the maximum length memcached accepts.
+   */
+  static constexpr size_t kDefaultHeadroom = 24 + 8 + 250;
+
+  static std::unique_ptr<folly::IOBuf> createValue(
+      size_t capacity,
+      size_t headroom = kDefaultHeadroom);
+
+  std::unique_ptr<folly::IOBuf> encode(MemcacheBinaryMessage& msg) override;
+};
+
+/**
+ * A memcache meta text protocol command or response line, such as
+ * "mg foo v t" or "HD c123", plus its data block.
+ *
+ * key is only set for commands that take one (every "m*" command except
+ * "mn").  The data length token of "ms" commands and "VA" responses is not
+ * kept in flags: it is implied by value, which is set only for those two.
+ *
+ * Messages decoded by MemcacheMetaDecoder point into line, which they keep
+ * alive, and reference the read buffer in value.  When building a message
+ * by hand, the pieces only need to stay valid until write() returns.
+ */
+struct MemcacheMetaMessage {
+  MemcacheMetaMessage() = default;
+  MemcacheMetaMessage(folly::StringPiece cmd,
+                      folly::StringPiece k,
+                      std::vector<folly::StringPiece> f = {},
+                      std::unique_ptr<folly::IOBuf> v = nullptr)
+      : command(cmd), key(k), flags(std::move(f)), value(std::move(v)) {}
+  MemcacheMetaMessage(MemcacheMetaMessage&&) = default;
+  MemcacheMetaMessage& operator=(MemcacheMetaMessage&&) = default;
+
+  static bool hasKey(folly::StringPiece command) {
+    return command.size() == 2 && command[0] == 'm' && command != "mn";
+  }
+
+  static bool hasValue(folly::StringPiece command) {
+    return command == "ms" || command == "VA";
+  }
+
+  folly::StringPiece command;
+  folly::StringPiece key;
+  std::vector<folly::StringPiece> flags;
+  std::unique_ptr<folly::IOBuf> value;
+
+  std::unique_ptr<folly::IOBuf> line;
+};
+
+/**
+ * Decodes memcache meta text protocol commands (on a server) or responses
+ * (on a client).  Lines are found by scanning each IOBuf segment for '\n'
+ * without rescanning, and data blocks are split off the read queue without
+ * copying.  Malformed input fires a read exception and discards the rest of
+ * the buffer.
+ */
+class MemcacheMetaDecoder : public ByteToMessageDecoder<MemcacheMetaMessage> {
+ public:
+  explicit MemcacheMetaDecoder(uint32_t maxValueLength = 64 * 1024 * 1024,
+                               size_t maxLineLength = 8 * 1024)
+      : maxValueLength_(maxValueLength), maxLineLength_(maxLineLength) {}
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              MemcacheMetaMessage& result,
+              size_t& needed) override;
+
+ private:
+  void fail(Context* ctx, folly::IOBufQueue& buf, const std::string& error);
+
+  uint32_t maxValueLength_;
+  size_t maxLineLength_;
+
+  // A message whose line was consumed, waiting for its data block
+  MemcacheMetaMessage pending_;
+  int64_t valueLength_{-1};
+  size_t scanned_{0};
+};
+
+/**
+ * Encodes memcache meta text protocol messages, writing the line into the
+ * value's headroom when it fits, like MemcacheBinaryEncoder.
+ */
+class MemcacheMetaEncoder : public MessageToByteEncoder<MemcacheMetaMessage> {
+ public:
+  std::unique_ptr<folly::IOBuf> encode(MemcacheMetaMessage& msg) override;
+};
+
+} // namespace wangle
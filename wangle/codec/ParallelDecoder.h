@@ -0,0 +1,160 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include <folly/Executor.h>
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <wangle/channel/Handler.h>
+#include <wangle/channel/ReadPauser.h>
+
+namespace wangle {
+
+/**
+ * Moves expensive decoding off the IO thread.  Each frame read (typically
+ * from a frame decoder such as LengthFieldBasedFrameDecoder) is decoded by
+ * decode on executor, and the results are fired back on the pipeline's
+ * EventBase in the order the frames arrived, however the decodes finish.
+ * A decode that throws fires a read exception in its place.
+ *
+ * At most maxOutstanding frames are decoded at a time.  Once that many are
+ * waiting to be fired, reads are paused (through the pipeline's
+ * AsyncSocketHandler) until half of them are done; frames that arrive
+ * before the pause takes effect, such as the rest of the same socket read,
+ * wait in the decoder for a free slot.  readEOF is held back until every
+ * earlier frame has been fired.
+ *
+ * decode runs concurrently on executor threads, so it must be thread safe.
+ */
+template <typename Frame, typename Message>
+class ParallelDecoder : public InboundHandler<Frame, Message> {
+ public:
+  typedef typename InboundHandler<Frame, Message>::Context Context;
+
+  ParallelDecoder(std::shared_ptr<folly::Executor> executor,
+                  std::function<Message(Frame)> decode,
+                  size_t maxOutstanding = 64)
+      : executor_(std::move(executor))
+      , decode_(std::make_shared<const std::function<Message(Frame)>>(
+          std::move(decode)))
+      , maxOutstanding_(maxOutstanding) {
+    CHECK_GT(maxOutstanding_, 0);
+  }
+
+  void read(Context* ctx, Frame frame) override {
+    uint64_t seq = firstPending_ + pending_.size();
+    pending_.emplace_back();
+    if (pending_.size() >= maxOutstanding_) {
+      pauser_.pause(ctx);
+    }
+    if (decoding_ < maxOutstanding_) {
+      startDecode(ctx, seq, std::move(frame));
+    } else {
+      waiting_.emplace_back(seq, std::move(frame));
+    }
+  }
+
+  void readEOF(Context* ctx) override {
+    if (pending_.empty()) {
+      ctx->fireReadEOF();
+    } else {
+      eofPending_ = true;
+    }
+  }
+
+  void transportInactive(Context* ctx) override {
+    pauser_.cancel();
+    ctx->fireTransportInactive();
+  }
+
+  size_t getOutstanding() const {
+    return pending_.size();
+  }
+
+ private:
+  void startDecode(Context* ctx, uint64_t seq, Frame frame) {
+    decoding_++;
+    auto transport = ctx->getTransport();
+    auto evb = transport && transport->getEventBase()
+      ? transport->getEventBase()
+      : folly::EventBaseManager::get()->getEventBase();
+    std::weak_ptr<bool> alive = alive_;
+    folly::via(executor_.get(),
+               [decode = decode_, frame = std::move(frame)]() mutable {
+                 return (*decode)(std::move(frame));
+               })
+      .via(evb)
+      .thenTry([this, alive, ctx, seq](folly::Try<Message> t) {
+        if (alive.lock()) {
+          complete(ctx, seq, std::move(t));
+        }
+      });
+  }
+
+  void complete(Context* ctx, uint64_t seq, folly::Try<Message> t) {
+    decoding_--;
+    pending_[seq - firstPending_] = std::move(t);
+    if (!waiting_.empty()) {
+      auto next = std::move(waiting_.front());
+      waiting_.pop_front();
+      startDecode(ctx, next.first, std::move(next.second));
+    }
+    while (!pending_.empty() && pending_.front().hasValue()) {
+      auto result = std::move(*pending_.front());
+      pending_.pop_front();
+      firstPending_++;
+      if (result.hasValue()) {
+        ctx->fireRead(std::move(result.value()));
+      } else {
+        ctx->fireReadException(std::move(result.exception()));
+      }
+    }
+
+    if (pauser_.isPaused() && pending_.size() <= maxOutstanding_ / 2) {
+      pauser_.resume();
+    }
+    if (eofPending_ && pending_.empty()) {
+      eofPending_ = false;
+      ctx->fireReadEOF();
+    }
+  }
+
+  std::shared_ptr<folly::Executor> executor_;
+  std::shared_ptr<const std::function<Message(Frame)>> decode_;
+  size_t maxOutstanding_;
+
+  // Results of the decodes in flight, in arrival order.  The front is the
+  // oldest frame not fired yet, with sequence number firstPending_.
+  std::deque<folly::Optional<folly::Try<Message>>> pending_;
+  uint64_t firstPending_{0};
+  // Frames read while maxOutstanding were decoding, with their sequence
+  // numbers
+  std::deque<std::pair<uint64_t, Frame>> waiting_;
+  size_t decoding_{0};
+  bool eofPending_{false};
+  ReadPauser pauser_;
+
+  // Guards callbacks that complete after the handler is destroyed
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+} // namespace wangle
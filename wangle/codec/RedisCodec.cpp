@@ -0,0 +1,357 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/RedisCodec.h>
+
+#include <algorithm>
+
+#include <folly/Conv.h>
+#include <folly/io/Cursor.h>
+#include <wangle/codec/IOBufQueueScan.h>
+
+namespace wangle {
+
+using folly::io::Cursor;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+
+namespace {
+
+// Bulk payloads up to this size are copied next to their header rather
+// than chained, which would cost an IOBuf per value
+constexpr size_t kMaxInlineBulkLength = 512;
+
+// Upper bound on the element count of a single aggregate
+constexpr int64_t kMaxAggregateLength = int64_t(1) << 32;
+
+typedef RedisValue::Type Type;
+
+void appendHeader(IOBufQueue& out, char type, int64_t n) {
+  char buf[24];
+  size_t len = 0;
+  buf[len++] = type;
+  uint64_t abs = n;
+  if (n < 0) {
+    buf[len++] = '-';
+    abs = -static_cast<uint64_t>(n);
+  }
+  len += folly::uint64ToBufferUnsafe(abs, buf + len);
+  buf[len++] = '\r';
+  buf[len++] = '\n';
+  out.append(buf, len);
+}
+
+void appendData(IOBufQueue& out, std::unique_ptr<IOBuf> data) {
+  if (!data) {
+    return;
+  }
+  if (data->computeChainDataLength() <= kMaxInlineBulkLength) {
+    for (auto range : *data) {
+      out.append(range.data(), range.size());
+    }
+  } else {
+    out.append(std::move(data));
+  }
+}
+
+void appendBlob(IOBufQueue& out, char type, std::unique_ptr<IOBuf> data) {
+  appendHeader(out, type, data ? data->computeChainDataLength() : 0);
+  appendData(out, std::move(data));
+  out.append("\r\n", 2);
+}
+
+void appendLine(IOBufQueue& out, char type, std::unique_ptr<IOBuf> data) {
+  out.append(&type, 1);
+  appendData(out, std::move(data));
+  out.append("\r\n", 2);
+}
+
+void appendValue(IOBufQueue& out, RedisValue& value, int version) {
+  bool resp3 = version >= 3;
+  switch (value.type) {
+    case Type::NULL_VALUE:
+      out.append(resp3 ? StringPiece("_\r\n") : StringPiece("$-1\r\n"));
+      break;
+    case Type::SIMPLE_STRING:
+      appendLine(out, '+', std::move(value.data));
+      break;
+    case Type::ERROR:
+      appendLine(out, '-', std::move(value.data));
+      break;
+    case Type::INTEGER:
+      appendHeader(out, ':', value.integer);
+      break;
+    case Type::BULK_STRING:
+      appendBlob(out, '$', std::move(value.data));
+      break;
+    case Type::BOOLEAN:
+      if (resp3) {
+        out.append(value.boolean ? StringPiece("#t\r\n")
+                                 : StringPiece("#f\r\n"));
+      } else {
+        appendHeader(out, ':', value.boolean ? 1 : 0);
+      }
+      break;
+    case Type::DOUBLE: {
+      auto d = folly::to<std::string>(value.doubleValue);
+      if (resp3) {
+        out.append(",", 1);
+        out.append(d);
+        out.append("\r\n", 2);
+      } else {
+        appendBlob(out, '$', IOBuf::copyBuffer(d));
+      }
+      break;
+    }
+    case Type::BIG_NUMBER:
+      if (resp3) {
+        appendLine(out, '(', std::move(value.data));
+      } else {
+        appendBlob(out, '$', std::move(value.data));
+      }
+      break;
+    case Type::BLOB_ERROR:
+      if (resp3) {
+        appendBlob(out, '!', std::move(value.data));
+      } else {
+        appendLine(out, '-', std::move(value.data));
+      }
+      break;
+    case Type::VERBATIM_STRING:
+      appendBlob(out, resp3 ? '=' : '$', std::move(value.data));
+      break;
+    case Type::ARRAY:
+    case Type::MAP:
+    case Type::SET:
+    case Type::PUSH: {
+      char type = '*';
+      int64_t count = value.elements.size();
+      if (resp3) {
+        if (value.type == Type::MAP) {
+          type = '%';
+          count /= 2;
+        } else if (value.type == Type::SET) {
+          type = '~';
+        } else if (value.type == Type::PUSH) {
+          type = '>';
+        }
+      }
+      appendHeader(out, type, count);
+      for (auto& element : value.elements) {
+        appendValue(out, element, version);
+      }
+      break;
+    }
+  }
+}
+
+} // namespace
+
+RedisDecoder::RedisDecoder(uint64_t maxBulkLength,
+                           size_t maxLineLength,
+                           size_t maxDepth)
+    : maxBulkLength_(maxBulkLength)
+    , maxLineLength_(maxLineLength)
+    , maxDepth_(maxDepth) {}
+
+bool RedisDecoder::decode(Context* ctx,
+                          IOBufQueue& buf,
+                          RedisValue& result,
+                          size_t& needed) {
+  while (true) {
+    RedisValue value;
+
+    if (bulkLength_ >= 0) {
+      uint64_t length = bulkLength_;
+      if (buf.chainLength() < length + 2) {
+        needed = length + 2 - buf.chainLength();
+        return false;
+      }
+      value = RedisValue(bulkType_,
+                         length ? buf.split(length) : IOBuf::create(0));
+      Cursor c(buf.front());
+      if (c.read<char>() != '\r' || c.read<char>() != '\n') {
+        fail(ctx, buf, "Missing CRLF after bulk string");
+        return false;
+      }
+      buf.trimStart(2);
+      bulkLength_ = -1;
+    } else {
+      auto eol = scanForByte(buf, '\n', scanned_);
+      if (eol < 0) {
+        if (buf.chainLength() > maxLineLength_) {
+          fail(ctx, buf, "Line too long");
+        }
+        return false;
+      }
+      if (static_cast<size_t>(eol) >= maxLineLength_) {
+        fail(ctx, buf, "Line too long");
+        return false;
+      }
+
+      auto line = buf.split(eol + 1);
+      scanned_ = 0;
+      line->coalesce();
+      if (line->length() < 3 || line->data()[line->length() - 2] != '\r') {
+        fail(ctx, buf, "Malformed line");
+        return false;
+      }
+      line->trimEnd(2);
+      char type = line->data()[0];
+      line->trimStart(1);
+      StringPiece payload(reinterpret_cast<const char*>(line->data()),
+                          line->length());
+
+      switch (type) {
+        case '+':
+          value = RedisValue(Type::SIMPLE_STRING, std::move(line));
+          break;
+        case '-':
+          value = RedisValue(Type::ERROR, std::move(line));
+          break;
+        case '(':
+          value = RedisValue(Type::BIG_NUMBER, std::move(line));
+          break;
+        case '_':
+          break;
+        case ':': {
+          auto i = folly::tryTo<int64_t>(payload);
+          if (!i.hasValue()) {
+            fail(ctx, buf, "Invalid integer");
+            return false;
+          }
+          value = RedisValue::integerValue(i.value());
+          break;
+        }
+        case '#':
+          if (payload != "t" && payload != "f") {
+            fail(ctx, buf, "Invalid boolean");
+            return false;
+          }
+          value = RedisValue(Type::BOOLEAN);
+          value.boolean = payload == "t";
+          break;
+        case ',': {
+          auto d = folly::tryTo<double>(payload);
+          if (!d.hasValue()) {
+            fail(ctx, buf, "Invalid double");
+            return false;
+          }
+          value = RedisValue(Type::DOUBLE);
+          value.doubleValue = d.value();
+          break;
+        }
+        case '$':
+        case '!':
+        case '=': {
+          auto length = folly::tryTo<int64_t>(payload);
+          if (!length.hasValue()) {
+            fail(ctx, buf, "Invalid bulk length");
+            return false;
+          }
+          if (length.value() == -1 && type == '$') {
+            // RESP2 null bulk string
+            break;
+          }
+          if (length.value() < 0 ||
+              static_cast<uint64_t>(length.value()) > maxBulkLength_) {
+            fail(ctx, buf, "Invalid bulk length");
+            return false;
+          }
+          bulkType_ = type == '$' ? Type::BULK_STRING
+            : type == '!' ? Type::BLOB_ERROR : Type::VERBATIM_STRING;
+          bulkLength_ = length.value();
+          continue;
+        }
+        case '*':
+        case '%':
+        case '~':
+        case '>': {
+          auto count = folly::tryTo<int64_t>(payload);
+          if (!count.hasValue()) {
+            fail(ctx, buf, "Invalid aggregate length");
+            return false;
+          }
+          if (count.value() == -1 && type == '*') {
+            // RESP2 null array
+            break;
+          }
+          if (count.value() < 0 || count.value() > kMaxAggregateLength) {
+            fail(ctx, buf, "Invalid aggregate length");
+            return false;
+          }
+          auto aggregateType = type == '*' ? Type::ARRAY
+            : type == '%' ? Type::MAP
+            : type == '~' ? Type::SET : Type::PUSH;
+          if (count.value() == 0) {
+            value = RedisValue(aggregateType);
+            break;
+          }
+          if (stack_.size() >= maxDepth_) {
+            fail(ctx, buf, "Aggregates nested too deeply");
+            return false;
+          }
+          int64_t elements = count.value() * (type == '%' ? 2 : 1);
+          stack_.push_back(Aggregate{RedisValue(aggregateType), elements});
+          stack_.back().value.elements.reserve(
+            std::min<int64_t>(elements, 1024));
+          continue;
+        }
+        default:
+          fail(ctx, buf, std::string("Unknown type ") + type);
+          return false;
+      }
+    }
+
+    // Hand the value to the innermost open aggregate, closing every
+    // aggregate it completes
+    bool complete = true;
+    while (!stack_.empty()) {
+      auto& top = stack_.back();
+      top.value.elements.push_back(std::move(value));
+      if (--top.remaining > 0) {
+        complete = false;
+        break;
+      }
+      value = std::move(top.value);
+      stack_.pop_back();
+    }
+
+    if (complete) {
+      result = std::move(value);
+      return true;
+    }
+  }
+}
+
+void RedisDecoder::fail(Context* ctx, IOBufQueue& buf,
+                        const std::string& error) {
+  stack_.clear();
+  bulkLength_ = -1;
+  scanned_ = 0;
+  buf.move();
+  ctx->fireReadException(
+    folly::make_exception_wrapper<std::runtime_error>(error));
+}
+
+std::unique_ptr<IOBuf> RedisEncoder::encode(RedisValue& msg) {
+  IOBufQueue out(IOBufQueue::cacheChainLength());
+  appendValue(out, msg, protocolVersion_);
+  return out.move();
+}
+
+} // namespace wangle
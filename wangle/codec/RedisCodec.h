@@ -0,0 +1,182 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <folly/Range.h>
+#include <wangle/codec/ByteToMessageDecoder.h>
+#include <wangle/codec/MessageToByteEncoder.h>
+
+namespace wangle {
+
+/**
+ * A RESP2 / RESP3 value.
+ *
+ * String-like values (simple strings, errors, bulk strings, blob errors,
+ * verbatim strings and big numbers) keep their payload in data.  Values
+ * decoded by RedisDecoder reference the read buffer there instead of
+ * copying it.  Aggregates keep their children in elements; a MAP stores its
+ * keys and values alternately.
+ */
+struct RedisValue {
+  enum class Type {
+    NULL_VALUE,
+    SIMPLE_STRING,
+    ERROR,
+    INTEGER,
+    BULK_STRING,
+    ARRAY,
+    // RESP3 only
+    BOOLEAN,
+    DOUBLE,
+    BIG_NUMBER,
+    BLOB_ERROR,
+    VERBATIM_STRING,
+    MAP,
+    SET,
+    PUSH
+  };
+
+  RedisValue() = default;
+  explicit RedisValue(Type t) : type(t) {}
+  RedisValue(Type t, std::unique_ptr<folly::IOBuf> d)
+      : type(t), data(std::move(d)) {}
+  RedisValue(RedisValue&&) = default;
+  RedisValue& operator=(RedisValue&&) = default;
+
+  static RedisValue simpleString(folly::StringPiece s) {
+    return RedisValue(Type::SIMPLE_STRING, folly::IOBuf::copyBuffer(s));
+  }
+  static RedisValue error(folly::StringPiece s) {
+    return RedisValue(Type::ERROR, folly::IOBuf::copyBuffer(s));
+  }
+  static RedisValue bulkString(folly::StringPiece s) {
+    return RedisValue(Type::BULK_STRING, folly::IOBuf::copyBuffer(s));
+  }
+  static RedisValue bulkString(std::unique_ptr<folly::IOBuf> buf) {
+    return RedisValue(Type::BULK_STRING, std::move(buf));
+  }
+  static RedisValue integerValue(int64_t i) {
+    RedisValue v(Type::INTEGER);
+    v.integer = i;
+    return v;
+  }
+  static RedisValue array(std::vector<RedisValue> elems) {
+    RedisValue v(Type::ARRAY);
+    v.elements = std::move(elems);
+    return v;
+  }
+
+  /**
+   * A command as sent by clients: an array of bulk strings.
+   */
+  static RedisValue command(std::initializer_list<folly::StringPiece> args) {
+    RedisValue v(Type::ARRAY);
+    v.elements.reserve(args.size());
+    for (auto arg : args) {
+      v.elements.push_back(bulkString(arg));
+    }
+    return v;
+  }
+
+  bool isNull() const {
+    return type == Type::NULL_VALUE;
+  }
+
+  /**
+   * Copies data out as a std::string, or returns "" if there is none.
+   */
+  std::string asString() const {
+    return data ? data->clone()->moveToFbString().toStdString() : "";
+  }
+
+  Type type{Type::NULL_VALUE};
+  int64_t integer{0};
+  double doubleValue{0};
+  bool boolean{false};
+  std::unique_ptr<folly::IOBuf> data;
+  std::vector<RedisValue> elements;
+};
+
+/**
+ * Decodes RESP2 and RESP3 values from a byte stream.
+ *
+ * Every complete value in the buffer is fired, so pipelined command batches
+ * decode in one read.  Partially received aggregates are built up on an
+ * explicit stack: each element is consumed from the queue as soon as it is
+ * complete, so a large array arriving over many reads is never rescanned,
+ * and bulk string payloads are split off the queue without copying.
+ *
+ * RESP3 streamed strings and aggregates ("$?", "*?") and attributes are not
+ * supported.  Malformed input fires a read exception and discards the rest
+ * of the buffer.
+ */
+class RedisDecoder : public ByteToMessageDecoder<RedisValue> {
+ public:
+  explicit RedisDecoder(uint64_t maxBulkLength = 512 * 1024 * 1024,
+                        size_t maxLineLength = 64 * 1024,
+                        size_t maxDepth = 128);
+
+  bool decode(Context* ctx,
+              folly::IOBufQueue& buf,
+              RedisValue& result,
+              size_t& needed) override;
+
+ private:
+  struct Aggregate {
+    RedisValue value;
+    int64_t remaining;
+  };
+
+  void fail(Context* ctx, folly::IOBufQueue& buf, const std::string& error);
+
+  uint64_t maxBulkLength_;
+  size_t maxLineLength_;
+  size_t maxDepth_;
+
+  std::vector<Aggregate> stack_;
+  // Length and type of a bulk payload whose header was already consumed
+  int64_t bulkLength_{-1};
+  RedisValue::Type bulkType_{RedisValue::Type::BULK_STRING};
+  size_t scanned_{0};
+};
+
+/**
+ * Encodes RedisValues.  Bulk payloads larger than a few hundred bytes are
+ * chained into the output rather than copied.
+ *
+ * With protocolVersion 2, types RESP2 lacks are written as the nearest
+ * RESP2 type:
+ *  - NULL_VALUE as a null bulk string,
+ *  - BOOLEAN as the integer 1 or 0,
+ *  - DOUBLE, BIG_NUMBER and VERBATIM_STRING as bulk strings,
+ *  - BLOB_ERROR as a simple error,
+ *  - MAP, SET and PUSH as arrays, a MAP's keys and values alternating.
+ */
+class RedisEncoder : public MessageToByteEncoder<RedisValue> {
+ public:
+  explicit RedisEncoder(int protocolVersion = 2)
+      : protocolVersion_(protocolVersion) {}
+
+  std::unique_ptr<folly::IOBuf> encode(RedisValue& msg) override;
+
+ private:
+  int protocolVersion_;
+};
+
+} // namespace wangle
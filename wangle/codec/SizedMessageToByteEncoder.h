@@ -0,0 +1,68 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <wangle/codec/EncoderBufferPool.h>
+#include <wangle/codec/MessageToByteEncoder.h>
+
+namespace wangle {
+
+/**
+ * A MessageToByteEncoder that serializes straight into a pooled output
+ * buffer instead of building the message in a temporary and copying it.
+ *
+ * The buffer is sized by estimateSize() and starts with headroom bytes of
+ * headroom, so that framing handlers further down the pipeline (such as
+ * LengthFieldPrepender) can write their header in front of the message
+ * without allocating.  serialize() may write more than the estimate; the
+ * queue then grows by chaining more buffers, which costs a little but is
+ * never wrong.
+ */
+template <typename M>
+class SizedMessageToByteEncoder : public MessageToByteEncoder<M> {
+ public:
+  static constexpr size_t kDefaultHeadroom = 16;
+
+  explicit SizedMessageToByteEncoder(size_t headroom = kDefaultHeadroom)
+      : headroom_(headroom) {}
+
+  /**
+   * The expected encoded size of msg.  A slight overestimate is cheaper
+   * than an underestimate.
+   */
+  virtual size_t estimateSize(const M& msg) = 0;
+
+  /**
+   * Appends the encoded msg to out, which has room for the estimated size.
+   */
+  virtual void serialize(M& msg, folly::IOBufQueue& out) = 0;
+
+  std::unique_ptr<folly::IOBuf> encode(M& msg) final {
+    folly::IOBufQueue out(folly::IOBufQueue::cacheChainLength());
+    out.append(EncoderBufferPool::allocate(estimateSize(msg), headroom_));
+    serialize(msg, out);
+    return out.move();
+  }
+
+ private:
+  size_t headroom_;
+};
+
+template <typename M>
+constexpr size_t SizedMessageToByteEncoder<M>::kDefaultHeadroom;
+
+} // namespace wangle
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+
+#include <folly/io/Compression.h>
+#include <wangle/channel/Handler.h>
+
+namespace wangle {
+
+struct StreamCompressionOptions {
+  folly::io::CodecType type{folly::io::CodecType::ZSTD};
+  int level{folly::io::COMPRESSION_LEVEL_DEFAULT};
+
+  /**
+   * Data both ends have seen before the connection starts, such as a
+   * typical message.  It primes the compression history, so even the first
+   * messages on a connection compress well.  Must be identical on both ends,
+   * which must also use the same type and level: the peer replays the
+   * dictionary through its own compressor, so a different codec or level
+   * leaves the two histories out of sync.
+   */
+  std::string dictionary;
+
+  /**
+   * Writes shorter than this are sent uncompressed.
+   */
+  size_t minCompressLength{64};
+
+  /**
+   * Decides whether a write is worth compressing.  Defaults to
+   * !StreamCompressionHandler::looksIncompressible().
+   */
+  std::function<bool(const folly::IOBuf&)> shouldCompress;
+
+  /**
+   * Writes are compressed and framed in pieces of at most this many bytes,
+   * and larger frames are rejected on read.  Must be identical on both ends.
+   */
+  uint32_t maxFrameLength{1024 * 1024};
+};
+
+/**
+ * Compresses outbound and decompresses inbound bytes with a
+ * folly::io::StreamCodec, typically added between AsyncSocketHandler and a
+ * frame decoder.
+ *
+ * Each direction is a single compression stream for the life of the
+ * connection, so later writes are compressed against everything sent
+ * before them; every write is flushed so the peer can decompress it as soon
+ * as it arrives.  On the wire each write is sent as frames with a 5 byte
+ * header (a type byte and a 32 bit length), which lets writes bypass the
+ * compressor: short writes and writes that already look compressed are sent
+ * as raw frames, without touching the compression stream.
+ *
+ * A corrupt stream fires a read exception and discards everything after it.
+ */
+class StreamCompressionHandler : public BytesToBytesHandler {
+ public:
+  explicit StreamCompressionHandler(StreamCompressionOptions options = {});
+
+  void read(Context* ctx, folly::IOBufQueue& q) override;
+
+  folly::Future<folly::Unit> write(Context* ctx,
+                                   std::unique_ptr<folly::IOBuf> buf) override;
+
+  /**
+   * Whether buf looks like it is already compressed or encrypted, judging by
+   * the byte entropy of a sample from its middle.
+   */
+  static bool looksIncompressible(const folly::IOBuf& buf);
+
+ private:
+  // Appends the compressed bytes of input, flushed, to out
+  void compress(const folly::IOBuf& input, folly::IOBufQueue& out);
+  // Appends the uncompressed bytes of input to out_, false on error
+  bool decompress(const folly::IOBuf& input);
+
+  void fail(Context* ctx, const std::string& error);
+
+  StreamCompressionOptions options_;
+  std::unique_ptr<folly::io::StreamCodec> compressor_;
+  std::unique_ptr<folly::io::StreamCodec> decompressor_;
+
+  folly::IOBufQueue out_{folly::IOBufQueue::cacheChainLength()};
+  bool failed_{false};
+};
+
+} // namespace wangle
@@ -22,6 +22,9 @@ namespace wangle {
 
 /*
  * StringCodec converts a pipeline from IOBufs to std::strings.
+ *
+ * Every message is copied in each direction; see StringPieceCodec for a
+ * variant that references the IOBufs instead.
  */
 class StringCodec : public Handler<std::unique_ptr<folly::IOBuf>, std::string,
                                    std::string, std::unique_ptr<folly::IOBuf>> {
@@ -34,7 +37,7 @@ class StringCodec : public Handler<std::unique_ptr<folly::IOBuf>, std::string,
     if (buf) {
       buf->coalesce();
       std::string data((const char*)buf->data(), buf->length());
-      ctx->fireRead(data);
+      ctx->fireRead(std::move(data));
     }
   }
 
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <wangle/channel/Handler.h>
+
+namespace wangle {
+
+/*
+ * A read-only view of a contiguous range of bytes that owns the IOBuf the
+ * bytes live in.  Moving an IOBufStringPiece keeps the view valid, and
+ * subpiece() shares the underlying buffer instead of copying it.
+ */
+class IOBufStringPiece {
+ public:
+  IOBufStringPiece() = default;
+
+  /*
+   * Takes ownership of buf.  A chained buf is coalesced, which is the only
+   * case where the bytes are copied.
+   */
+  explicit IOBufStringPiece(std::unique_ptr<folly::IOBuf> buf)
+      : buf_(std::move(buf)) {
+    if (buf_) {
+      buf_->coalesce();
+      piece_ = folly::StringPiece(
+          reinterpret_cast<const char*>(buf_->data()), buf_->length());
+    }
+  }
+
+  /*
+   * Copies data, for messages that are not already in an IOBuf.
+   */
+  explicit IOBufStringPiece(folly::StringPiece data)
+      : IOBufStringPiece(folly::IOBuf::copyBuffer(data.data(), data.size())) {}
+
+  IOBufStringPiece(IOBufStringPiece&&) = default;
+  IOBufStringPiece& operator=(IOBufStringPiece&&) = default;
+
+  folly::StringPiece str() const {
+    return piece_;
+  }
+
+  const char* data() const {
+    return piece_.data();
+  }
+
+  size_t size() const {
+    return piece_.size();
+  }
+
+  bool empty() const {
+    return piece_.empty();
+  }
+
+  std::string toString() const {
+    return piece_.str();
+  }
+
+  /*
+   * Returns a view of [first, first + length) sharing this buffer.
+   */
+  IOBufStringPiece subpiece(
+      size_t first, size_t length = folly::StringPiece::npos) const {
+    IOBufStringPiece sub;
+    if (buf_) {
+      sub.buf_ = buf_->cloneOne();
+      sub.piece_ = piece_.subpiece(first, length);
+    }
+    return sub;
+  }
+
+  /*
+   * Narrows the view to sub, which must point into str().  Lets parsers
+   * consume a prefix in place, e.g. piece.advanceTo(rest).
+   */
+  void advanceTo(folly::StringPiece sub) {
+    DCHECK(sub.begin() >= piece_.begin() && sub.end() <= piece_.end());
+    piece_ = sub;
+  }
+
+  /*
+   * Releases the underlying IOBuf, trimmed to the current view.
+   */
+  std::unique_ptr<folly::IOBuf> moveToIOBuf() && {
+    if (buf_) {
+      buf_->trimStart(
+          reinterpret_cast<const uint8_t*>(piece_.begin()) - buf_->data());
+      buf_->trimEnd(buf_->length() - piece_.size());
+    }
+    piece_.clear();
+    return std::move(buf_);
+  }
+
+ private:
+  std::unique_ptr<folly::IOBuf> buf_;
+  folly::StringPiece piece_;
+};
+
+/*
+ * StringPieceCodec converts a pipeline from IOBufs to IOBufStringPieces.
+ *
+ * Unlike StringCodec, messages keep referencing the buffers they were read
+ * into, so text protocols can be parsed in place without copying each frame
+ * into a std::string, and outbound messages are written without copying.
+ */
+class StringPieceCodec
+    : public Handler<std::unique_ptr<folly::IOBuf>, IOBufStringPiece,
+                     IOBufStringPiece, std::unique_ptr<folly::IOBuf>> {
+ public:
+  typedef typename Handler<
+   std::unique_ptr<folly::IOBuf>, IOBufStringPiece,
+   IOBufStringPiece, std::unique_ptr<folly::IOBuf>>::Context Context;
+
+  void read(Context* ctx, std::unique_ptr<folly::IOBuf> buf) override {
+    if (buf) {
+      ctx->fireRead(IOBufStringPiece(std::move(buf)));
+    }
+  }
+
+  folly::Future<folly::Unit> write(Context* ctx,
+                                   IOBufStringPiece msg) override {
+    return ctx->fireWrite(std::move(msg).moveToIOBuf());
+  }
+};
+
+} // namespace wangle
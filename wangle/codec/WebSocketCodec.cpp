@@ -0,0 +1,366 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <wangle/codec/WebSocketCodec.h>
+
+#include <cstring>
+
+#include <folly/Bits.h>
+#include <folly/Portability.h>
+#include <folly/Random.h>
+#include <folly/io/Cursor.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif FOLLY_SSE >= 2
+#include <emmintrin.h>
+#endif
+
+namespace wangle {
+
+using folly::io::Cursor;
+using folly::IOBuf;
+using folly::IOBufQueue;
+using folly::StringPiece;
+
+typedef WebSocketMessage::Opcode Opcode;
+
+namespace {
+
+// Payloads up to this size are copied behind the frame header rather than
+// chained, which would cost an extra IOBuf per message
+constexpr size_t kMaxInlinePayloadLength = 512;
+
+constexpr size_t kMaxFrameHeaderLength = 14;
+constexpr uint64_t kMaxControlPayloadLength = 125;
+
+void applyMask(IOBuf* buf, const std::array<uint8_t, 4>& key) {
+  size_t offset = 0;
+  auto seg = buf;
+  do {
+    applyWebSocketMask(seg->writableData(), seg->length(), key, offset);
+    offset += seg->length();
+    seg = seg->next();
+  } while (seg != buf);
+}
+
+} // namespace
+
+void applyWebSocketMask(uint8_t* data,
+                        size_t length,
+                        const std::array<uint8_t, 4>& key,
+                        size_t offset) {
+  // Rotate the key so that its first byte applies to data[0]
+  uint8_t rotated[4];
+  for (size_t i = 0; i < 4; i++) {
+    rotated[i] = key[(offset + i) & 3];
+  }
+  uint32_t mask32;
+  memcpy(&mask32, rotated, sizeof(mask32));
+
+  // Every step below is a multiple of 4 bytes, so the key stays aligned
+  size_t i = 0;
+#ifdef __AVX2__
+  auto mask256 = _mm256_set1_epi32(int(mask32));
+  for (; i + 32 <= length; i += 32) {
+    auto p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask256));
+  }
+#endif
+#if FOLLY_SSE >= 2
+  auto mask128 = _mm_set1_epi32(int(mask32));
+  for (; i + 16 <= length; i += 16) {
+    auto p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask128));
+  }
+#endif
+  uint64_t mask64 = (uint64_t(mask32) << 32) | mask32;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    word ^= mask64;
+    memcpy(data + i, &word, sizeof(word));
+  }
+  for (; i < length; i++) {
+    data[i] ^= rotated[i & 3];
+  }
+}
+
+WebSocketMessage WebSocketMessage::close(uint16_t code, StringPiece reason) {
+  auto payload = IOBuf::create(2 + reason.size());
+  uint16_t be = folly::Endian::big(code);
+  memcpy(payload->writableData(), &be, 2);
+  memcpy(payload->writableData() + 2, reason.data(), reason.size());
+  payload->append(2 + reason.size());
+  return WebSocketMessage(Opcode::CLOSE, std::move(payload));
+}
+
+uint16_t WebSocketMessage::closeCode() const {
+  if (!payload || payload->computeChainDataLength() < 2) {
+    return 1005;
+  }
+  Cursor c(payload.get());
+  return c.readBE<uint16_t>();
+}
+
+WebSocketCodec::WebSocketCodec(Direction direction,
+                               uint64_t maxMessageSize,
+                               std::shared_ptr<WebSocketCompressor> compressor)
+    : direction_(direction)
+    , maxMessageSize_(maxMessageSize)
+    , compressor_(std::move(compressor)) {}
+
+void WebSocketCodec::read(Context* ctx, IOBufQueue& q) {
+  while (!failed_) {
+    if (!inFrame_ && !parseFrameHeader(ctx, q)) {
+      break;
+    }
+    if (q.chainLength() < frame_.length) {
+      break;
+    }
+    inFrame_ = false;
+    auto payload = frame_.length ? q.split(frame_.length) : IOBuf::create(0);
+    if (frame_.masked) {
+      // The payload bytes belong to this frame alone, so unmask in place
+      applyMask(payload.get(), frame_.mask);
+    }
+    handleFrame(ctx, std::move(payload));
+  }
+  if (failed_) {
+    q.move();
+  }
+}
+
+bool WebSocketCodec::parseFrameHeader(Context* ctx, IOBufQueue& q) {
+  if (q.chainLength() < 2) {
+    return false;
+  }
+  Cursor c(q.front());
+  auto b0 = c.read<uint8_t>();
+  auto b1 = c.read<uint8_t>();
+  uint8_t length7 = b1 & 0x7f;
+  bool masked = b1 & 0x80;
+  size_t headerLength = 2 + (masked ? 4 : 0) +
+    (length7 == 126 ? 2 : length7 == 127 ? 8 : 0);
+  if (q.chainLength() < headerLength) {
+    return false;
+  }
+
+  FrameHeader h;
+  h.fin = b0 & 0x80;
+  h.rsv1 = b0 & 0x40;
+  h.opcode = b0 & 0x0f;
+  h.masked = masked;
+  if (length7 == 126) {
+    h.length = c.readBE<uint16_t>();
+  } else if (length7 == 127) {
+    h.length = c.readBE<uint64_t>();
+  } else {
+    h.length = length7;
+  }
+  if (masked) {
+    c.pull(h.mask.data(), h.mask.size());
+  }
+
+  if (b0 & 0x30) {
+    fail(ctx, "Reserved bits set");
+    return false;
+  }
+  if (masked != (direction_ == Direction::SERVER)) {
+    fail(ctx,
+         masked ? "Masked frame from server" : "Unmasked frame from client");
+    return false;
+  }
+  if (h.opcode & 0x8) {
+    if (h.opcode != uint8_t(Opcode::CLOSE) &&
+        h.opcode != uint8_t(Opcode::PING) &&
+        h.opcode != uint8_t(Opcode::PONG)) {
+      fail(ctx, "Unknown opcode");
+      return false;
+    }
+    if (!h.fin || h.rsv1 || h.length > kMaxControlPayloadLength) {
+      fail(ctx, "Invalid control frame");
+      return false;
+    }
+  } else {
+    if (h.opcode > uint8_t(Opcode::BINARY)) {
+      fail(ctx, "Unknown opcode");
+      return false;
+    }
+    if (h.opcode == uint8_t(Opcode::CONTINUATION)) {
+      if (!fragmented_) {
+        fail(ctx, "Unexpected continuation frame");
+        return false;
+      }
+      if (h.rsv1) {
+        fail(ctx, "Reserved bits set");
+        return false;
+      }
+    } else {
+      if (fragmented_) {
+        fail(ctx, "Expected continuation frame");
+        return false;
+      }
+      if (h.rsv1 && !compressor_) {
+        fail(ctx, "Reserved bits set");
+        return false;
+      }
+    }
+    if (h.length > maxMessageSize_ ||
+        fragments_.chainLength() + h.length > maxMessageSize_) {
+      fail(ctx, "Message too large");
+      return false;
+    }
+  }
+
+  q.trimStart(headerLength);
+  frame_ = h;
+  inFrame_ = true;
+  return true;
+}
+
+void WebSocketCodec::handleFrame(Context* ctx,
+                                 std::unique_ptr<IOBuf> payload) {
+  auto opcode = static_cast<Opcode>(frame_.opcode);
+  if (frame_.opcode & 0x8) {
+    ctx->fireRead(WebSocketMessage(opcode, std::move(payload)));
+    return;
+  }
+
+  if (opcode != Opcode::CONTINUATION) {
+    if (frame_.fin) {
+      fireMessage(ctx, WebSocketMessage(opcode, std::move(payload)),
+                  frame_.rsv1);
+      return;
+    }
+    fragmented_ = true;
+    fragmentOpcode_ = opcode;
+    fragmentCompressed_ = frame_.rsv1;
+  }
+
+  fragments_.append(std::move(payload));
+  if (frame_.fin) {
+    fragmented_ = false;
+    auto message = fragments_.move();
+    fireMessage(
+      ctx,
+      WebSocketMessage(fragmentOpcode_,
+                       message ? std::move(message) : IOBuf::create(0)),
+      fragmentCompressed_);
+  }
+}
+
+void WebSocketCodec::fireMessage(Context* ctx,
+                                 WebSocketMessage msg,
+                                 bool compressed) {
+  if (compressed) {
+    try {
+      msg.payload = compressor_->decompress(std::move(msg.payload));
+    } catch (const std::exception& e) {
+      fail(ctx, std::string("Decompression failed: ") + e.what());
+      return;
+    }
+    if (msg.payload->computeChainDataLength() > maxMessageSize_) {
+      fail(ctx, "Message too large");
+      return;
+    }
+  }
+  ctx->fireRead(std::move(msg));
+}
+
+void WebSocketCodec::fail(Context* ctx, const std::string& error) {
+  failed_ = true;
+  inFrame_ = false;
+  fragmented_ = false;
+  fragments_.move();
+  ctx->fireReadException(
+    folly::make_exception_wrapper<std::runtime_error>(error));
+}
+
+folly::Future<folly::Unit> WebSocketCodec::write(Context* ctx,
+                                                 WebSocketMessage msg) {
+  auto payload = std::move(msg.payload);
+  if (!payload) {
+    payload = IOBuf::create(0);
+  }
+
+  uint8_t b0 = 0x80 | uint8_t(msg.opcode);
+  if (msg.isControl()) {
+    if (payload->computeChainDataLength() > kMaxControlPayloadLength) {
+      throw std::runtime_error("Control frame payload too long");
+    }
+  } else if (compressor_) {
+    auto compressed = compressor_->compress(*payload);
+    if (compressed) {
+      payload = std::move(compressed);
+      b0 |= 0x40;
+    }
+  }
+  uint64_t length = payload->computeChainDataLength();
+
+  bool mask = direction_ == Direction::CLIENT;
+  uint8_t header[kMaxFrameHeaderLength];
+  size_t headerLength = 0;
+  header[headerLength++] = b0;
+  uint8_t maskBit = mask ? 0x80 : 0;
+  if (length < 126) {
+    header[headerLength++] = maskBit | length;
+  } else if (length <= UINT16_MAX) {
+    header[headerLength++] = maskBit | 126;
+    uint16_t be = folly::Endian::big(uint16_t(length));
+    memcpy(header + headerLength, &be, sizeof(be));
+    headerLength += sizeof(be);
+  } else {
+    header[headerLength++] = maskBit | 127;
+    uint64_t be = folly::Endian::big(length);
+    memcpy(header + headerLength, &be, sizeof(be));
+    headerLength += sizeof(be);
+  }
+  if (mask) {
+    std::array<uint8_t, 4> key;
+    uint32_t r = folly::Random::secureRand32();
+    memcpy(key.data(), &r, key.size());
+    memcpy(header + headerLength, key.data(), key.size());
+    headerLength += key.size();
+    if (length) {
+      // Masking must not modify buffers the caller still references
+      payload->unshare();
+      applyMask(payload.get(), key);
+    }
+  }
+
+  if (!payload->isChained() && !payload->isSharedOne() &&
+      payload->headroom() >= headerLength) {
+    payload->prepend(headerLength);
+    memcpy(payload->writableData(), header, headerLength);
+    return ctx->fireWrite(std::move(payload));
+  }
+  if (length <= kMaxInlinePayloadLength) {
+    auto out = IOBuf::create(headerLength + length);
+    memcpy(out->writableData(), header, headerLength);
+    out->append(headerLength);
+    for (auto range : *payload) {
+      memcpy(out->writableTail(), range.data(), range.size());
+      out->append(range.size());
+    }
+    return ctx->fireWrite(std::move(out));
+  }
+  auto out = IOBuf::copyBuffer(header, headerLength);
+  out->prependChain(std::move(payload));
+  return ctx->fireWrite(std::move(out));
+}
+
+} // namespace wangle
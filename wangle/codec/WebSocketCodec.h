@@ -0,0 +1,177 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+
+#include <folly/Range.h>
+#include <wangle/channel/Handler.h>
+
+namespace wangle {
+
+/**
+ * XORs length bytes at data with the WebSocket masking key.  offset is the
+ * position of data within the frame payload, so a payload split over
+ * several IOBufs can be masked one segment at a time.  Masking and
+ * unmasking are the same operation.
+ *
+ * Works 32 bytes at a time with AVX2, 16 with SSE2 and 8 otherwise.
+ */
+void applyWebSocketMask(uint8_t* data,
+                        size_t length,
+                        const std::array<uint8_t, 4>& key,
+                        size_t offset = 0);
+
+/**
+ * A complete WebSocket message, or a control frame.
+ */
+struct WebSocketMessage {
+  enum class Opcode : uint8_t {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xa
+  };
+
+  WebSocketMessage() = default;
+  WebSocketMessage(Opcode op, std::unique_ptr<folly::IOBuf> p)
+      : opcode(op), payload(std::move(p)) {}
+
+  static WebSocketMessage text(folly::StringPiece s) {
+    return WebSocketMessage(Opcode::TEXT, folly::IOBuf::copyBuffer(s));
+  }
+  static WebSocketMessage binary(std::unique_ptr<folly::IOBuf> buf) {
+    return WebSocketMessage(Opcode::BINARY, std::move(buf));
+  }
+  static WebSocketMessage close(uint16_t code, folly::StringPiece reason = "");
+
+  bool isControl() const {
+    return uint8_t(opcode) & 0x8;
+  }
+
+  /**
+   * The status code of a CLOSE frame, or 1005 (no status) if it has none.
+   */
+  uint16_t closeCode() const;
+
+  Opcode opcode{Opcode::BINARY};
+  std::unique_ptr<folly::IOBuf> payload;
+};
+
+/**
+ * A permessage-deflate (RFC 7692) implementation, or any other
+ * per-message compression extension using the RSV1 bit.
+ *
+ * compress() and decompress() see whole message payloads and perform the
+ * full extension transform, including stripping and restoring the trailing
+ * 0x00 0x00 0xff 0xff of a deflate flush.  Implementations keep the
+ * compression context between calls when context takeover was negotiated.
+ */
+class WebSocketCompressor {
+ public:
+  virtual ~WebSocketCompressor() = default;
+
+  /**
+   * Returns the compressed payload, or nullptr to send this message
+   * uncompressed (e.g. because it is too small to benefit).
+   */
+  virtual std::unique_ptr<folly::IOBuf> compress(
+    const folly::IOBuf& payload) = 0;
+
+  /**
+   * Throws on corrupt input.
+   */
+  virtual std::unique_ptr<folly::IOBuf> decompress(
+    std::unique_ptr<folly::IOBuf> payload) = 0;
+};
+
+/**
+ * A WebSocket (RFC 6455) frame codec, for use once the HTTP upgrade
+ * handshake is done.
+ *
+ * A SERVER codec requires incoming frames to be masked and writes unmasked
+ * frames, a CLIENT codec does the opposite with a random key per frame.
+ * Payloads are split off the read queue without copying and unmasked in
+ * place with applyWebSocketMask; fragmented messages are reassembled by
+ * chaining the fragments.  Control frames are fired as soon as they arrive,
+ * even between the fragments of a message.  Replying to PING and CLOSE is
+ * left to the handlers above.
+ *
+ * Each message is written as a single frame.  With a compressor, data
+ * messages are compressed on write and messages with RSV1 set are
+ * decompressed on read.  Protocol violations fire a read exception and
+ * discard the rest of the stream; the caller should then close the
+ * connection with status 1002.  TEXT payloads are not validated as UTF-8.
+ */
+class WebSocketCodec : public Handler<folly::IOBufQueue&, WebSocketMessage,
+                                      WebSocketMessage,
+                                      std::unique_ptr<folly::IOBuf>> {
+ public:
+  typedef typename Handler<folly::IOBufQueue&, WebSocketMessage,
+                           WebSocketMessage,
+                           std::unique_ptr<folly::IOBuf>>::Context Context;
+
+  enum class Direction {
+    SERVER,
+    CLIENT
+  };
+
+  explicit WebSocketCodec(
+      Direction direction,
+      uint64_t maxMessageSize = 16 * 1024 * 1024,
+      std::shared_ptr<WebSocketCompressor> compressor = nullptr);
+
+  void read(Context* ctx, folly::IOBufQueue& q) override;
+
+  folly::Future<folly::Unit> write(Context* ctx,
+                                   WebSocketMessage msg) override;
+
+ private:
+  struct FrameHeader {
+    bool fin;
+    bool rsv1;
+    uint8_t opcode;
+    bool masked;
+    std::array<uint8_t, 4> mask;
+    uint64_t length;
+  };
+
+  // Returns false if more bytes are needed
+  bool parseFrameHeader(Context* ctx, folly::IOBufQueue& q);
+  void handleFrame(Context* ctx, std::unique_ptr<folly::IOBuf> payload);
+  void fireMessage(Context* ctx, WebSocketMessage msg, bool compressed);
+  void fail(Context* ctx, const std::string& error);
+
+  Direction direction_;
+  uint64_t maxMessageSize_;
+  std::shared_ptr<WebSocketCompressor> compressor_;
+
+  bool inFrame_{false};
+  bool failed_{false};
+  FrameHeader frame_;
+
+  // A fragmented message being reassembled
+  bool fragmented_{false};
+  WebSocketMessage::Opcode fragmentOpcode_{
+    WebSocketMessage::Opcode::BINARY};
+  bool fragmentCompressed_{false};
+  folly::IOBufQueue fragments_{folly::IOBufQueue::cacheChainLength()};
+};
+
+} // namespace wangle
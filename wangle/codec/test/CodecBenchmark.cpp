@@ -0,0 +1,257 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/portability/GFlags.h>
+#include <wangle/codec/EncoderBufferPool.h>
+#include <wangle/codec/FixedLengthFrameDecoder.h>
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+#include <wangle/codec/LengthFieldPrepender.h>
+#include <wangle/codec/LineBasedFrameDecoder.h>
+#include <wangle/codec/StringCodec.h>
+
+using namespace folly;
+using namespace wangle;
+
+/*
+ * Decoder benchmarks take the frame size, the number of frames delivered
+ * by each read, and the size of the IOBufs the input is split into (0 for a
+ * single IOBuf); small segments model reads from a slow or fragmenting
+ * network.  Times are per read, not per frame.
+ */
+
+namespace {
+
+template <class M>
+class Sink : public InboundHandler<M> {
+ public:
+  void read(typename InboundHandler<M>::Context*, M msg) override {
+    doNotOptimizeAway(msg);
+  }
+};
+
+class BytesSink : public OutboundBytesToBytesHandler {
+ public:
+  Future<Unit> write(Context*, std::unique_ptr<IOBuf> buf) override {
+    doNotOptimizeAway(buf);
+    return makeFuture();
+  }
+};
+
+std::unique_ptr<IOBuf> segment(const std::string& data, size_t segmentSize) {
+  if (segmentSize == 0) {
+    return IOBuf::copyBuffer(data);
+  }
+  std::unique_ptr<IOBuf> head;
+  for (size_t i = 0; i < data.size(); i += segmentSize) {
+    auto seg = IOBuf::copyBuffer(data.data() + i,
+                                 std::min(segmentSize, data.size() - i));
+    if (head) {
+      head->prependChain(std::move(seg));
+    } else {
+      head = std::move(seg);
+    }
+  }
+  return head;
+}
+
+template <class Decoder>
+void decodeFrames(uint32_t iters,
+                  Decoder decoder,
+                  const std::string& frames,
+                  size_t segmentSize) {
+  BenchmarkSuspender suspender;
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  (*pipeline)
+    .addBack(std::move(decoder))
+    .addBack(Sink<std::unique_ptr<IOBuf>>())
+    .finalize();
+  auto input = segment(frames, segmentSize);
+  suspender.dismiss();
+
+  for (uint32_t i = 0; i < iters; i++) {
+    IOBufQueue q(IOBufQueue::cacheChainLength());
+    q.append(input->clone());
+    pipeline->read(q);
+  }
+}
+
+void lineDecoder(uint32_t iters,
+                 size_t frameSize,
+                 size_t batch,
+                 size_t segmentSize) {
+  std::string frame(frameSize - 1, 'x');
+  frame += '\n';
+  std::string frames;
+  for (size_t i = 0; i < batch; i++) {
+    frames += frame;
+  }
+  decodeFrames(iters, LineBasedFrameDecoder(), frames, segmentSize);
+}
+
+void lengthFieldDecoder(uint32_t iters,
+                        size_t frameSize,
+                        size_t batch,
+                        size_t segmentSize) {
+  uint32_t length = frameSize - 4;
+  std::string frame;
+  frame += char(length >> 24);
+  frame += char(length >> 16);
+  frame += char(length >> 8);
+  frame += char(length);
+  frame.append(length, 'x');
+  std::string frames;
+  for (size_t i = 0; i < batch; i++) {
+    frames += frame;
+  }
+  decodeFrames(iters, LengthFieldBasedFrameDecoder(), frames, segmentSize);
+}
+
+void fixedLengthDecoder(uint32_t iters,
+                        size_t frameSize,
+                        size_t batch,
+                        size_t segmentSize) {
+  std::string frames(frameSize * batch, 'x');
+  decodeFrames(iters, FixedLengthFrameDecoder(frameSize), frames, segmentSize);
+}
+
+// With enough headroom the length field is written in front of the message,
+// otherwise it is chained in a buffer of its own
+void lengthFieldPrepender(uint32_t iters, size_t frameSize, size_t headroom) {
+  BenchmarkSuspender suspender;
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  (*pipeline)
+    .addBack(BytesSink())
+    .addBack(LengthFieldPrepender())
+    .finalize();
+  suspender.dismiss();
+
+  for (uint32_t i = 0; i < iters; i++) {
+    auto buf = IOBuf::create(headroom + frameSize);
+    buf->advance(headroom);
+    buf->append(frameSize);
+    pipeline->write(std::move(buf));
+  }
+}
+
+void stringCodecRead(uint32_t iters, size_t frameSize, size_t segmentSize) {
+  BenchmarkSuspender suspender;
+  auto pipeline = Pipeline<std::unique_ptr<IOBuf>, std::string>::create();
+  (*pipeline)
+    .addBack(StringCodec())
+    .addBack(Sink<std::string>())
+    .finalize();
+  auto input = segment(std::string(frameSize, 'x'), segmentSize);
+  suspender.dismiss();
+
+  for (uint32_t i = 0; i < iters; i++) {
+    pipeline->read(input->clone());
+  }
+}
+
+void stringCodecWrite(uint32_t iters, size_t frameSize) {
+  BenchmarkSuspender suspender;
+  auto pipeline = Pipeline<std::unique_ptr<IOBuf>, std::string>::create();
+  (*pipeline)
+    .addBack(BytesSink())
+    .addBack(StringCodec())
+    .finalize();
+  std::string msg(frameSize, 'x');
+  suspender.dismiss();
+
+  for (uint32_t i = 0; i < iters; i++) {
+    pipeline->write(msg);
+  }
+}
+
+// An encoder's output buffer: allocated, filled and freed once written
+void ioBufCreate(uint32_t iters, size_t size) {
+  for (uint32_t i = 0; i < iters; i++) {
+    auto buf = IOBuf::create(size);
+    buf->append(size);
+    doNotOptimizeAway(buf->writableData()[size - 1] = 'x');
+  }
+}
+
+void encoderBufferPool(uint32_t iters, size_t size) {
+  for (uint32_t i = 0; i < iters; i++) {
+    auto buf = EncoderBufferPool::allocate(size);
+    buf->append(size);
+    doNotOptimizeAway(buf->writableData()[size - 1] = 'x');
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(lineDecoder, 16B_x1, 16, 1, 0)
+BENCHMARK_NAMED_PARAM(lineDecoder, 16B_x64, 16, 64, 0)
+BENCHMARK_NAMED_PARAM(lineDecoder, 16B_x64_seg64, 16, 64, 64)
+BENCHMARK_NAMED_PARAM(lineDecoder, 1K_x1, 1024, 1, 0)
+BENCHMARK_NAMED_PARAM(lineDecoder, 1K_x16, 1024, 16, 0)
+BENCHMARK_NAMED_PARAM(lineDecoder, 1K_x16_seg64, 1024, 16, 64)
+BENCHMARK_NAMED_PARAM(lineDecoder, 64K_x1_seg4K, 65536, 1, 4096)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 16B_x1, 16, 1, 0)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 16B_x64, 16, 64, 0)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 16B_x64_seg64, 16, 64, 64)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 1K_x1, 1024, 1, 0)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 1K_x16, 1024, 16, 0)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 1K_x16_seg64, 1024, 16, 64)
+BENCHMARK_NAMED_PARAM(lengthFieldDecoder, 64K_x1_seg4K, 65536, 1, 4096)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 16B_x1, 16, 1, 0)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 16B_x64, 16, 64, 0)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 16B_x64_seg64, 16, 64, 64)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 1K_x1, 1024, 1, 0)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 1K_x16, 1024, 16, 0)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 1K_x16_seg64, 1024, 16, 64)
+BENCHMARK_NAMED_PARAM(fixedLengthDecoder, 64K_x1_seg4K, 65536, 1, 4096)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(lengthFieldPrepender, 16B_chained, 16, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(lengthFieldPrepender, 16B_headroom, 16, 4)
+BENCHMARK_NAMED_PARAM(lengthFieldPrepender, 1K_chained, 1024, 0)
+BENCHMARK_RELATIVE_NAMED_PARAM(lengthFieldPrepender, 1K_headroom, 1024, 4)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(stringCodecRead, 16B, 16, 0)
+BENCHMARK_NAMED_PARAM(stringCodecRead, 1K, 1024, 0)
+BENCHMARK_NAMED_PARAM(stringCodecRead, 1K_seg64, 1024, 64)
+BENCHMARK_NAMED_PARAM(stringCodecRead, 64K_seg4K, 65536, 4096)
+BENCHMARK_NAMED_PARAM(stringCodecWrite, 16B, 16)
+BENCHMARK_NAMED_PARAM(stringCodecWrite, 1K, 1024)
+BENCHMARK_NAMED_PARAM(stringCodecWrite, 64K, 65536)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(ioBufCreate, 256B, 256)
+BENCHMARK_RELATIVE_NAMED_PARAM(encoderBufferPool, 256B, 256)
+BENCHMARK_NAMED_PARAM(ioBufCreate, 4K, 4096)
+BENCHMARK_RELATIVE_NAMED_PARAM(encoderBufferPool, 4K, 4096)
+BENCHMARK_NAMED_PARAM(ioBufCreate, 64K, 65536)
+BENCHMARK_RELATIVE_NAMED_PARAM(encoderBufferPool, 64K, 65536)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
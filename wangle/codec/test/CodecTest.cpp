@@ -14,12 +14,21 @@
  * limitations under the License.
  */
 
+#include <thread>
+
+#include <folly/hash/Checksum.h>
 #include <folly/portability/GTest.h>
 
+#include <wangle/codec/Crc32cFrameDecoder.h>
+#include <wangle/codec/Crc32cFramePrepender.h>
+#include <wangle/codec/DelimiterBasedFrameDecoder.h>
+#include <wangle/codec/EncoderBufferPool.h>
 #include <wangle/codec/FixedLengthFrameDecoder.h>
 #include <wangle/codec/LengthFieldBasedFrameDecoder.h>
 #include <wangle/codec/LengthFieldPrepender.h>
 #include <wangle/codec/LineBasedFrameDecoder.h>
+#include <wangle/codec/SizedMessageToByteEncoder.h>
+#include <wangle/codec/StringPieceCodec.h>
 #include <wangle/codec/test/CodecTestUtils.h>
 
 using namespace folly;
@@ -418,6 +427,236 @@ TEST(LengthFieldFrameDecoder, FailTestNotEnoughBytes) {
   EXPECT_EQ(called, 1);
 }
 
+TEST(LengthFieldFramePipeline, Varint) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(test::BytesReflector())
+    .addBack(LengthFieldPrepender(
+        LengthFieldBasedFrameDecoder::kVarintLengthField))
+    .addBack(LengthFieldBasedFrameDecoder(
+        LengthFieldBasedFrameDecoder::kVarintLengthField, UINT_MAX, 0, 0, 0))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        auto sz = buf->computeChainDataLength();
+        called++;
+        // 300 needs a two byte varint
+        EXPECT_EQ(sz, 302);
+      }))
+    .finalize();
+
+  auto buf = createZeroedBuffer(300);
+  pipeline->write(std::move(buf));
+  EXPECT_EQ(called, 1);
+}
+
+TEST(LengthFieldFrameDecoder, VarintSplit) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(LengthFieldBasedFrameDecoder(
+        LengthFieldBasedFrameDecoder::kVarintLengthField, UINT_MAX, 1, 0, 3))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        auto sz = buf->computeChainDataLength();
+        called++;
+        EXPECT_EQ(sz, 128);
+      }))
+    .finalize();
+
+  auto bufHeader = createZeroedBuffer(2);
+  RWPrivateCursor c(bufHeader.get());
+  c.write((uint8_t)0xCA); // header
+  c.write((uint8_t)0x80); // first byte of varint 128
+  auto bufLength = createZeroedBuffer(1);
+  RWPrivateCursor c2(bufLength.get());
+  c2.write((uint8_t)0x01); // last byte of varint 128
+  auto bufData = createZeroedBuffer(128);
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(std::move(bufHeader));
+  pipeline->read(q);
+  EXPECT_EQ(called, 0);
+
+  q.append(std::move(bufLength));
+  pipeline->read(q);
+  EXPECT_EQ(called, 0);
+
+  q.append(std::move(bufData));
+  pipeline->read(q);
+  EXPECT_EQ(called, 1);
+}
+
+TEST(LengthFieldFrameDecoder, FailTestVarintTooLong) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(LengthFieldBasedFrameDecoder(
+        LengthFieldBasedFrameDecoder::kVarintLengthField, UINT_MAX, 0, 0, 0))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_EQ(nullptr, buf);
+        called++;
+      }))
+    .finalize();
+
+  auto bufFrame = createZeroedBuffer(16);
+  std::memset(bufFrame->writableData(), 0xFF, 16); // never terminates
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(std::move(bufFrame));
+  pipeline->read(q);
+  EXPECT_EQ(called, 1);
+  EXPECT_EQ(q.chainLength(), 0);
+}
+
+TEST(LengthFieldFramePipeline, Static) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(test::BytesReflector())
+    .addBack(LengthFieldPrepender(2, 0, false, false))
+    .addBack(StaticLengthFieldBasedFrameDecoder<2, false>(100))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        auto sz = buf->computeChainDataLength();
+        called++;
+        EXPECT_EQ(sz, 5);
+      }))
+    .finalize();
+
+  pipeline->write(createZeroedBuffer(5));
+  pipeline->write(createZeroedBuffer(5));
+  EXPECT_EQ(called, 2);
+}
+
+TEST(LengthFieldFrameDecoder, StaticFailTestLengthFieldFrameSize) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(StaticLengthFieldBasedFrameDecoder<4>(10))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_EQ(nullptr, buf);
+        called++;
+      }))
+    .finalize();
+
+  auto bufFrame = createZeroedBuffer(16);
+  RWPrivateCursor c(bufFrame.get());
+  c.writeBE((uint32_t)12); // frame size
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(std::move(bufFrame));
+  pipeline->read(q);
+  EXPECT_EQ(called, 1);
+}
+
+TEST(Crc32cFramePipeline, SimpleTest) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(test::BytesReflector())
+    .addBack(Crc32cFramePrepender())
+    .addBack(Crc32cFrameDecoder())
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_NE(nullptr, buf);
+        called++;
+        EXPECT_EQ("hello", buf->moveToFbString().toStdString());
+      }))
+    .finalize();
+
+  auto buf = IOBuf::copyBuffer("hel");
+  buf->prependChain(IOBuf::copyBuffer("lo"));
+  pipeline->write(std::move(buf));
+  pipeline->write(IOBuf::copyBuffer("hello"));
+  EXPECT_EQ(called, 2);
+}
+
+TEST(Crc32cFrameDecoder, Split) {
+  uint8_t payload[100];
+  std::memset(payload, 0xAB, sizeof(payload));
+  auto bytes = createZeroedBuffer(108);
+  RWPrivateCursor c(bytes.get());
+  c.writeBE((uint32_t)100); // frame size
+  c.push(payload, sizeof(payload));
+  c.writeBE(folly::crc32c(payload, sizeof(payload)));
+
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+  (*pipeline)
+    .addBack(Crc32cFrameDecoder())
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_NE(nullptr, buf);
+        called++;
+        EXPECT_EQ(buf->computeChainDataLength(), 100);
+      }))
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  for (size_t i = 0; i < bytes->length(); i++) {
+    q.append(IOBuf::copyBuffer(bytes->data() + i, 1));
+    pipeline->read(q);
+    EXPECT_EQ(called, i == bytes->length() - 1 ? 1 : 0);
+  }
+  EXPECT_EQ(q.chainLength(), 0);
+}
+
+TEST(Crc32cFrameDecoder, FailTestChecksum) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+  int failed = 0;
+
+  (*pipeline)
+    .addBack(Crc32cFrameDecoder())
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        if (buf) {
+          called++;
+        } else {
+          failed++;
+        }
+      }))
+    .finalize();
+
+  auto bufFrame = createZeroedBuffer(12);
+  RWPrivateCursor c(bufFrame.get());
+  c.writeBE((uint32_t)4); // frame size, then 4 bytes of data and a bad crc
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(bufFrame));
+  pipeline->read(q);
+  EXPECT_EQ(failed, 1);
+  EXPECT_EQ(called, 0);
+  EXPECT_EQ(q.chainLength(), 0);
+}
+
+TEST(Crc32cFrameDecoder, FailTestFrameSize) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+
+  (*pipeline)
+    .addBack(Crc32cFrameDecoder(10))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_EQ(nullptr, buf);
+        called++;
+      }))
+    .finalize();
+
+  auto bufFrame = createZeroedBuffer(20);
+  RWPrivateCursor c(bufFrame.get());
+  c.writeBE((uint32_t)12); // frame size
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(bufFrame));
+  pipeline->read(q);
+  EXPECT_EQ(called, 1);
+  EXPECT_EQ(q.chainLength(), 0);
+}
+
 TEST(LineBasedFrameDecoder, Simple) {
   auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
   int called = 0;
@@ -640,3 +879,271 @@ TEST(LineBasedFrameDecoder, DoubleCarriage) {
   pipeline->read(q);
   EXPECT_EQ(called, 2);
 }
+
+TEST(DelimiterBasedFrameDecoder, Simple) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  std::vector<std::string> frames;
+
+  (*pipeline)
+    .addBack(DelimiterBasedFrameDecoder({std::string(1, '\0')}))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_NE(nullptr, buf);
+        frames.push_back(buf->moveToFbString().toStdString());
+      }))
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(IOBuf::copyBuffer(std::string("ABC\0DEF\0GH", 10)));
+  pipeline->read(q);
+  EXPECT_EQ(2, frames.size());
+
+  q.append(IOBuf::copyBuffer(std::string("I\0", 2)));
+  pipeline->read(q);
+  ASSERT_EQ(3, frames.size());
+  EXPECT_EQ("ABC", frames[0]);
+  EXPECT_EQ("DEF", frames[1]);
+  EXPECT_EQ("GHI", frames[2]);
+  EXPECT_EQ(0, q.chainLength());
+}
+
+TEST(DelimiterBasedFrameDecoder, MultiByteAcrossSegments) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  std::vector<std::string> frames;
+
+  (*pipeline)
+    .addBack(DelimiterBasedFrameDecoder({"\r\n\r\n"}, UINT_MAX, false))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_NE(nullptr, buf);
+        frames.push_back(buf->moveToFbString().toStdString());
+      }))
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(IOBuf::copyBuffer("Host: a\r\n"));
+  pipeline->read(q);
+  q.append(IOBuf::copyBuffer("\r"));
+  pipeline->read(q);
+  EXPECT_EQ(0, frames.size());
+
+  q.append(IOBuf::copyBuffer("\nnext"));
+  pipeline->read(q);
+  ASSERT_EQ(1, frames.size());
+  EXPECT_EQ("Host: a\r\n\r\n", frames[0]);
+  EXPECT_EQ(4, q.chainLength());
+}
+
+TEST(DelimiterBasedFrameDecoder, EarliestDelimiterWins) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  std::vector<std::string> frames;
+
+  (*pipeline)
+    .addBack(DelimiterBasedFrameDecoder({"\r\n", "|"}))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        ASSERT_NE(nullptr, buf);
+        frames.push_back(buf->moveToFbString().toStdString());
+      }))
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(IOBuf::copyBuffer("a|b\r\nc\rd|"));
+  pipeline->read(q);
+  ASSERT_EQ(3, frames.size());
+  EXPECT_EQ("a", frames[0]);
+  EXPECT_EQ("b", frames[1]);
+  EXPECT_EQ("c\rd", frames[2]);
+}
+
+TEST(DelimiterBasedFrameDecoder, Fail) {
+  auto pipeline = Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>>::create();
+  int called = 0;
+  int failed = 0;
+
+  (*pipeline)
+    .addBack(DelimiterBasedFrameDecoder({"\r\n"}, 4))
+    .addBack(test::FrameTester([&](std::unique_ptr<IOBuf> buf) {
+        if (buf) {
+          called++;
+          EXPECT_EQ(2, buf->computeChainDataLength());
+        } else {
+          failed++;
+        }
+      }))
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+
+  q.append(IOBuf::copyBuffer("abcdef"));
+  pipeline->read(q);
+  EXPECT_EQ(0, called);
+  EXPECT_EQ(1, failed);
+
+  // still discarding until the next delimiter
+  q.append(IOBuf::copyBuffer("gh\r\nok\r\n"));
+  pipeline->read(q);
+  EXPECT_EQ(1, called);
+  EXPECT_EQ(1, failed);
+  EXPECT_EQ(0, q.chainLength());
+}
+
+namespace {
+class StringPieceTester : public InboundHandler<IOBufStringPiece> {
+ public:
+  explicit StringPieceTester(
+      folly::Function<void(IOBufStringPiece)> test)
+      : test_(std::move(test)) {}
+
+  void read(Context*, IOBufStringPiece msg) override {
+    test_(std::move(msg));
+  }
+
+ private:
+  folly::Function<void(IOBufStringPiece)> test_;
+};
+
+}
+
+TEST(StringPieceCodec, ReadWithoutCopy) {
+  auto pipeline =
+    Pipeline<std::unique_ptr<IOBuf>, IOBufStringPiece>::create();
+  int called = 0;
+
+  auto buf = IOBuf::copyBuffer("hello world");
+  auto data = buf->data();
+
+  (*pipeline)
+    .addBack(StringPieceCodec())
+    .addBack(StringPieceTester([&](IOBufStringPiece msg) {
+        called++;
+        EXPECT_EQ("hello world", msg.str());
+        EXPECT_EQ(reinterpret_cast<const char*>(data), msg.data());
+
+        auto world = msg.subpiece(6);
+        msg = IOBufStringPiece();
+        EXPECT_EQ("world", world.str());
+        EXPECT_EQ(reinterpret_cast<const char*>(data) + 6, world.data());
+      }))
+    .finalize();
+
+  pipeline->read(std::move(buf));
+  EXPECT_EQ(called, 1);
+}
+
+TEST(StringPieceCodec, WriteWithoutCopy) {
+  auto pipeline =
+    Pipeline<std::unique_ptr<IOBuf>, IOBufStringPiece>::create();
+  test::BytesCollector collector;
+
+  (*pipeline)
+    .addBack(&collector)
+    .addBack(StringPieceCodec())
+    .finalize();
+
+  auto buf = IOBuf::copyBuffer("GET /index.html");
+  auto data = buf->data();
+  IOBufStringPiece msg(std::move(buf));
+  msg.advanceTo(msg.str().subpiece(4));
+  pipeline->write(std::move(msg));
+
+  pipeline->write(IOBufStringPiece(folly::StringPiece("copied")));
+
+  ASSERT_EQ(2, collector.bufs.size());
+  EXPECT_EQ(data + 4, collector.bufs[0]->data());
+  EXPECT_EQ("/index.html", collector.bufs[0]->moveToFbString());
+  EXPECT_EQ("copied", collector.bufs[1]->moveToFbString());
+}
+
+TEST(EncoderBufferPool, Reuse) {
+  auto buf = EncoderBufferPool::allocate(1500, 16);
+  EXPECT_EQ(0, buf->length());
+  EXPECT_GE(buf->headroom(), 16);
+  EXPECT_GE(buf->tailroom(), 1500);
+  auto block = buf->buffer();
+  buf.reset();
+
+  buf = EncoderBufferPool::allocate(2000);
+  EXPECT_EQ(block, buf->buffer());
+  buf.reset();
+
+  EncoderBufferPool::trim();
+  auto small = EncoderBufferPool::allocate(100, 16);
+  EXPECT_GE(small->headroom(), 16);
+  EXPECT_GE(small->tailroom(), 100);
+  auto large = EncoderBufferPool::allocate(EncoderBufferPool::kMaxBlockSize);
+  EXPECT_GE(large->tailroom(), EncoderBufferPool::kMaxBlockSize);
+}
+
+TEST(EncoderBufferPool, FreedAfterThreadExit) {
+  std::unique_ptr<IOBuf> buf;
+  std::thread([&] {
+    buf = EncoderBufferPool::allocate(4096);
+    // Constructed before the thread's cache, so destroyed after it
+    static thread_local std::unique_ptr<IOBuf> late;
+    late = EncoderBufferPool::allocate(4096);
+  }).join();
+  // Freed on another thread
+  buf.reset();
+}
+
+namespace {
+class SizedStringEncoder : public SizedMessageToByteEncoder<std::string> {
+ public:
+  size_t estimateSize(const std::string& msg) override {
+    return estimate ? estimate : msg.size();
+  }
+
+  void serialize(std::string& msg, IOBufQueue& out) override {
+    out.append(msg);
+  }
+
+  size_t estimate{0};
+};
+}
+
+TEST(SizedMessageToByteEncoder, FramesInHeadroom) {
+  auto pipeline = Pipeline<IOBufQueue&, std::string>::create();
+  test::BytesCollector collector;
+
+  (*pipeline)
+    .addBack(&collector)
+    .addBack(Crc32cFramePrepender())
+    .addBack(LengthFieldPrepender(2))
+    .addBack(SizedStringEncoder())
+    .finalize();
+
+  pipeline->write(std::string("hello"));
+  ASSERT_EQ(1, collector.bufs.size());
+  auto& buf = collector.bufs[0];
+  EXPECT_FALSE(buf->isChained());
+  EXPECT_EQ(4 + 2 + 5 + 4, buf->length());
+
+  Cursor c(buf.get());
+  EXPECT_EQ(2 + 5, c.readBE<uint32_t>());
+  EXPECT_EQ(5, c.readBE<uint16_t>());
+  EXPECT_EQ("hello", c.readFixedString(5));
+  EXPECT_EQ(folly::crc32c(buf->data() + 4, 7), c.readBE<uint32_t>());
+}
+
+TEST(SizedMessageToByteEncoder, Underestimate) {
+  auto pipeline = Pipeline<IOBufQueue&, std::string>::create();
+  test::BytesCollector collector;
+  SizedStringEncoder encoder;
+  encoder.estimate = 1;
+
+  (*pipeline)
+    .addBack(&collector)
+    .addBack(LengthFieldPrepender())
+    .addBack(&encoder)
+    .finalize();
+
+  std::string large(100000, 'x');
+  pipeline->write(large);
+  ASSERT_EQ(1, collector.bufs.size());
+  auto& buf = collector.bufs[0];
+  EXPECT_EQ(4 + large.size(), buf->computeChainDataLength());
+  Cursor c(buf.get());
+  EXPECT_EQ(large.size(), c.readBE<uint32_t>());
+  EXPECT_EQ(large, c.readFixedString(large.size()));
+}
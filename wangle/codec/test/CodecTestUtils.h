@@ -17,9 +17,12 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <folly/Function.h>
 #include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
 #include <wangle/channel/Handler.h>
 
 namespace wangle {
@@ -56,5 +59,29 @@ class BytesReflector : public wangle::BytesToBytesHandler {
     return folly::makeFuture();
   }
 };
+
+// Collects the bytes written to the front of a pipeline
+class BytesCollector : public wangle::OutboundBytesToBytesHandler {
+ public:
+  folly::Future<folly::Unit> write(
+      Context*,
+      std::unique_ptr<folly::IOBuf> buf) override {
+    out.append(buf->clone());
+    bufs.push_back(std::move(buf));
+    return folly::makeFuture();
+  }
+
+  // Everything written, as a string
+  std::string str() const {
+    return out.empty()
+      ? ""
+      : out.front()->clone()->moveToFbString().toStdString();
+  }
+
+  // Each write, as written
+  std::vector<std::unique_ptr<folly::IOBuf>> bufs;
+  // Everything written, to read from or feed to another pipeline
+  folly::IOBufQueue out{folly::IOBufQueue::cacheChainLength()};
+};
 }
 }
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/String.h>
+#include <folly/portability/GFlags.h>
+#include <wangle/codec/ByteToMessageDecoder.h>
+#include <wangle/codec/HTTP1Codec.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+/*
+ * Stand-in for an external callback-style parser wired in through
+ * ByteToMessageDecoder: each header block is copied into a std::string,
+ * and the start line and every header name and value are copied out.
+ */
+struct CopiedRequest {
+  std::string method;
+  std::string url;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::unique_ptr<IOBuf> body;
+};
+
+class CopyingHTTPDecoder : public ByteToMessageDecoder<CopiedRequest> {
+ public:
+  bool decode(Context*,
+              IOBufQueue& q,
+              CopiedRequest& result,
+              size_t&) override {
+    if (q.empty()) {
+      return false;
+    }
+    // The benchmark always reads a single contiguous buffer
+    DCHECK(!q.front()->isChained());
+    StringPiece input(reinterpret_cast<const char*>(q.front()->data()),
+                      q.front()->length());
+    auto end = input.find("\r\n\r\n");
+    if (end == StringPiece::npos) {
+      return false;
+    }
+    std::string data(input.data(), end);
+
+    std::vector<StringPiece> lines;
+    folly::split("\r\n", data, lines);
+    std::vector<StringPiece> startLine;
+    folly::split(' ', lines[0], startLine);
+    result.method = startLine[0].str();
+    result.url = startLine[1].str();
+
+    size_t contentLength = 0;
+    for (size_t i = 1; i < lines.size(); i++) {
+      auto colon = lines[i].find(':');
+      result.headers.emplace_back(
+        lines[i].subpiece(0, colon).str(),
+        trimWhitespace(lines[i].subpiece(colon + 1)).str());
+      if (result.headers.back().first == "Content-Length") {
+        contentLength = to<size_t>(result.headers.back().second);
+      }
+    }
+    if (q.chainLength() < end + 4 + contentLength) {
+      return false;
+    }
+    q.trimStart(end + 4);
+    if (contentLength) {
+      result.body = q.split(contentLength);
+    }
+    return true;
+  }
+};
+
+template <class M>
+class Sink : public InboundHandler<M> {
+ public:
+  void read(typename InboundHandler<M>::Context*, M msg) override {
+    doNotOptimizeAway(msg);
+  }
+};
+
+std::string makeRequests(size_t count) {
+  std::string request =
+    "POST /api/v1/items HTTP/1.1\r\n"
+    "Host: internal.example.com\r\n"
+    "User-Agent: wangle-benchmark/1.0\r\n"
+    "Accept: application/json\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "X-Request-Id: 0123456789abcdef0123456789abcdef\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 16\r\n"
+    "\r\n"
+    "{\"key\":\"value\"}\n";
+  std::string requests;
+  for (size_t i = 0; i < count; i++) {
+    requests += request;
+  }
+  return requests;
+}
+
+template <class Decoder, class M>
+void decodeRequests(uint32_t iters, size_t pipelined, Decoder decoder) {
+  BenchmarkSuspender suspender;
+  auto pipeline = Pipeline<IOBufQueue&, M>::create();
+  (*pipeline)
+    .addBack(std::move(decoder))
+    .addBack(Sink<M>())
+    .finalize();
+  auto requests = IOBuf::copyBuffer(makeRequests(pipelined));
+  suspender.dismiss();
+
+  for (uint32_t i = 0; i < iters; i++) {
+    IOBufQueue q(IOBufQueue::cacheChainLength());
+    q.append(requests->clone());
+    pipeline->read(q);
+  }
+}
+
+void copyingParser(uint32_t iters, size_t pipelined) {
+  decodeRequests<CopyingHTTPDecoder, CopiedRequest>(
+    iters, pipelined, CopyingHTTPDecoder());
+}
+
+void http1Codec(uint32_t iters, size_t pipelined) {
+  decodeRequests<HTTP1Codec, HTTPMessage>(
+    iters, pipelined, HTTP1Codec(HTTP1Codec::Direction::SERVER));
+}
+
+} // namespace
+
+BENCHMARK_PARAM(copyingParser, 1)
+BENCHMARK_RELATIVE_PARAM(http1Codec, 1)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(copyingParser, 16)
+BENCHMARK_RELATIVE_PARAM(http1Codec, 16)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
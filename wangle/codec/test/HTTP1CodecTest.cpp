@@ -0,0 +1,262 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <wangle/codec/HTTP1Codec.h>
+#include <wangle/codec/test/CodecTestUtils.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<IOBufQueue&, HTTPMessage> HTTPPipeline;
+
+class MessageCollector : public InboundHandler<HTTPMessage> {
+ public:
+  void read(Context*, HTTPMessage msg) override {
+    messages.push_back(std::move(msg));
+  }
+
+  void readException(Context*, exception_wrapper) override {
+    errors++;
+  }
+
+  std::vector<HTTPMessage> messages;
+  int errors{0};
+};
+
+std::string bodyString(const HTTPMessage& msg) {
+  return msg.getBody()
+    ? msg.getBody()->clone()->moveToFbString().toStdString()
+    : "";
+}
+
+// Feed data to the pipeline in pieces of at most step bytes
+void feed(HTTPPipeline& pipeline, IOBufQueue& q, StringPiece data,
+          size_t step) {
+  while (!data.empty()) {
+    auto n = std::min(step, data.size());
+    q.append(IOBuf::copyBuffer(data.data(), n));
+    pipeline.read(q);
+    data.advance(n);
+  }
+}
+
+} // namespace
+
+TEST(HTTP1Codec, PipelinedRequests) {
+  auto pipeline = HTTPPipeline::create();
+  MessageCollector collector;
+  (*pipeline)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER))
+    .addBack(&collector)
+    .finalize();
+
+  const std::string requests =
+    "GET /health HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "\r\n"
+    "POST /submit HTTP/1.1\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "hello"
+    "PUT /chunked HTTP/1.0\r\n"
+    "transfer-encoding: chunked\r\n"
+    "\r\n"
+    "5;ext=1\r\nhello\r\n"
+    "6\r\n world\r\n"
+    "0\r\n"
+    "X-Trailer: 1\r\n"
+    "\r\n";
+
+  // Whole buffer at once, and one byte at a time
+  for (size_t step : {requests.size(), size_t(1)}) {
+    collector.messages.clear();
+    IOBufQueue q(IOBufQueue::cacheChainLength());
+    feed(*pipeline, q, requests, step);
+
+    ASSERT_EQ(3, collector.messages.size());
+    EXPECT_EQ(0, collector.errors);
+    EXPECT_EQ(0, q.chainLength());
+
+    auto& get = collector.messages[0];
+    EXPECT_EQ("GET", get.getMethod());
+    EXPECT_EQ("/health", get.getURL());
+    EXPECT_EQ("example.com", get.getHeader("host").value_or(""));
+    EXPECT_EQ(nullptr, get.getBody());
+    EXPECT_TRUE(get.isKeepAlive());
+
+    auto& post = collector.messages[1];
+    EXPECT_EQ("POST", post.getMethod());
+    EXPECT_EQ("hello", bodyString(post));
+
+    auto& put = collector.messages[2];
+    EXPECT_EQ("/chunked", put.getURL());
+    EXPECT_EQ(std::make_pair(uint8_t(1), uint8_t(0)), put.getHTTPVersion());
+    EXPECT_FALSE(put.isKeepAlive());
+    EXPECT_EQ("hello world", bodyString(put));
+  }
+}
+
+TEST(HTTP1Codec, HeadersParsedInPlace) {
+  auto pipeline = HTTPPipeline::create();
+  MessageCollector collector;
+  (*pipeline)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER))
+    .addBack(&collector)
+    .finalize();
+
+  auto buf = IOBuf::copyBuffer("GET / HTTP/1.1\r\nHost: a\r\n\r\n");
+  auto begin = reinterpret_cast<const char*>(buf->data());
+  auto end = begin + buf->length();
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(buf));
+  pipeline->read(q);
+
+  ASSERT_EQ(1, collector.messages.size());
+  auto host = collector.messages[0].getHeader("Host").value();
+  EXPECT_TRUE(host.begin() >= begin && host.end() <= end);
+}
+
+TEST(HTTP1Codec, ClientResponses) {
+  auto pipeline = HTTPPipeline::create();
+  MessageCollector collector;
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::CLIENT))
+    .addBack(&collector)
+    .finalize();
+
+  HTTPMessage head;
+  head.setMethod("HEAD");
+  head.setURL("/");
+  pipeline->write(std::move(head));
+
+  HTTPMessage get;
+  get.setMethod("GET");
+  get.setURL("/");
+  get.addHeader("Host", "example.com");
+  pipeline->write(std::move(get));
+
+  EXPECT_EQ(
+    "HEAD / HTTP/1.1\r\n\r\n"
+    "GET / HTTP/1.1\r\nHost: example.com\r\n\r\n",
+    writes.str());
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  feed(*pipeline, q,
+       "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n"
+       "HTTP/1.1 100 Continue\r\n\r\n"
+       "HTTP/1.1 404 Not Found\r\nContent-Length: 4\r\n\r\nnope",
+       7);
+
+  ASSERT_EQ(2, collector.messages.size());
+  EXPECT_EQ(200, collector.messages[0].getStatusCode());
+  EXPECT_EQ(nullptr, collector.messages[0].getBody());
+  EXPECT_EQ(404, collector.messages[1].getStatusCode());
+  EXPECT_EQ("Not Found", collector.messages[1].getStatusMessage());
+  EXPECT_EQ("nope", bodyString(collector.messages[1]));
+}
+
+TEST(HTTP1Codec, ClientBodyUntilEOF) {
+  auto pipeline = HTTPPipeline::create();
+  MessageCollector collector;
+  (*pipeline)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::CLIENT))
+    .addBack(&collector)
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  feed(*pipeline, q, "HTTP/1.0 200 OK\r\n\r\nsome body", 4);
+  EXPECT_EQ(0, collector.messages.size());
+
+  pipeline->readEOF();
+  ASSERT_EQ(1, collector.messages.size());
+  EXPECT_EQ("some body", bodyString(collector.messages[0]));
+}
+
+TEST(HTTP1Codec, SerializeResponses) {
+  auto pipeline = HTTPPipeline::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER))
+    .finalize();
+
+  HTTPMessage ok;
+  ok.setStatus(200, "OK");
+  ok.setBody(IOBuf::copyBuffer("hello"));
+  pipeline->write(std::move(ok));
+
+  HTTPMessage chunked;
+  chunked.setStatus(200, "OK");
+  chunked.addHeader("Transfer-Encoding", "chunked");
+  chunked.setBody(IOBuf::copyBuffer("0123456789abcdefX"));
+  pipeline->write(std::move(chunked));
+
+  HTTPMessage notModified;
+  notModified.setStatus(304, "Not Modified");
+  pipeline->write(std::move(notModified));
+
+  EXPECT_EQ(
+    "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "11\r\n0123456789abcdefX\r\n0\r\n\r\n"
+    "HTTP/1.1 304 Not Modified\r\n\r\n",
+    writes.str());
+}
+
+TEST(HTTP1Codec, InvalidStatusFailsWrite) {
+  auto pipeline = HTTPPipeline::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER))
+    .finalize();
+
+  EXPECT_TRUE(pipeline->write(HTTPMessage()).getTry().hasException());
+  EXPECT_EQ("", writes.str());
+}
+
+TEST(HTTP1Codec, Malformed) {
+  auto pipeline = HTTPPipeline::create();
+  MessageCollector collector;
+  (*pipeline)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER, 64))
+    .addBack(&collector)
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  feed(*pipeline, q, "GET / HTTP/1.1\r\nNo colon here\r\n\r\n", 100);
+  EXPECT_EQ(0, collector.messages.size());
+  EXPECT_EQ(1, collector.errors);
+  EXPECT_EQ(0, q.chainLength());
+
+  auto pipeline2 = HTTPPipeline::create();
+  MessageCollector collector2;
+  (*pipeline2)
+    .addBack(HTTP1Codec(HTTP1Codec::Direction::SERVER, 64))
+    .addBack(&collector2)
+    .finalize();
+
+  IOBufQueue q2(IOBufQueue::cacheChainLength());
+  feed(*pipeline2, q2, "GET / HTTP/1.1\r\nX-Long: " + std::string(100, 'a'),
+       100);
+  EXPECT_EQ(1, collector2.errors);
+}
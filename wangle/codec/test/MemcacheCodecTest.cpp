@@ -0,0 +1,251 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <wangle/codec/MemcacheCodec.h>
+#include <wangle/codec/test/CodecTestUtils.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+template <class M>
+class MessageCollector : public InboundHandler<M> {
+ public:
+  void read(typename InboundHandler<M>::Context*, M msg) override {
+    messages.push_back(std::move(msg));
+  }
+
+  void readException(typename InboundHandler<M>::Context*,
+                     exception_wrapper) override {
+    errors++;
+  }
+
+  std::vector<M> messages;
+  int errors{0};
+};
+
+std::string toString(const std::unique_ptr<IOBuf>& buf) {
+  return buf ? buf->clone()->moveToFbString().toStdString() : "";
+}
+
+// A GET response: flags extras, key "foo", value "bar"
+const uint8_t kGetResponse[] = {
+  0x81, 0x0c, 0x00, 0x03, 0x04, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x0a, 0xde, 0xad, 0xbe, 0xef,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07,
+  0x00, 0x00, 0x00, 0x01, 'f', 'o', 'o', 'b', 'a', 'r'};
+
+} // namespace
+
+TEST(MemcacheBinaryDecoder, Response) {
+  MessageCollector<MemcacheBinaryMessage> collector;
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheBinaryMessage>::create();
+  (*pipeline)
+    .addBack(MemcacheBinaryDecoder())
+    .addBack(&collector)
+    .finalize();
+
+  // Two responses, the second split across reads
+  std::string data(reinterpret_cast<const char*>(kGetResponse),
+                   sizeof(kGetResponse));
+  data += data;
+  auto buf = IOBuf::copyBuffer(data);
+  auto begin = buf->data();
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::wrapBuffer(begin, sizeof(kGetResponse) + 10));
+  pipeline->read(q);
+  ASSERT_EQ(1, collector.messages.size());
+  q.append(IOBuf::wrapBuffer(begin + sizeof(kGetResponse) + 10,
+                             sizeof(kGetResponse) - 10));
+  pipeline->read(q);
+  ASSERT_EQ(2, collector.messages.size());
+  EXPECT_EQ(0, q.chainLength());
+
+  auto& msg = collector.messages[0];
+  EXPECT_EQ(MemcacheBinaryMessage::Magic::RESPONSE, msg.magic);
+  EXPECT_EQ(MemcacheBinaryMessage::Opcode::GETK, msg.opcode);
+  EXPECT_EQ(0xdeadbeef, msg.opaque);
+  EXPECT_EQ(7, msg.cas);
+  EXPECT_EQ(4, msg.extras->computeChainDataLength());
+  EXPECT_EQ("foo", toString(msg.key));
+  EXPECT_EQ("bar", toString(msg.value));
+  // The value is a slice of the read buffer
+  EXPECT_EQ(begin + sizeof(kGetResponse) - 3, msg.value->data());
+
+  EXPECT_EQ("bar", toString(collector.messages[1].value));
+}
+
+TEST(MemcacheBinaryDecoder, InvalidMagic) {
+  MessageCollector<MemcacheBinaryMessage> collector;
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheBinaryMessage>::create();
+  (*pipeline)
+    .addBack(MemcacheBinaryDecoder())
+    .addBack(&collector)
+    .finalize();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::copyBuffer(std::string(24, 'x')));
+  pipeline->read(q);
+  EXPECT_EQ(0, collector.messages.size());
+  EXPECT_EQ(1, collector.errors);
+  EXPECT_EQ(0, q.chainLength());
+}
+
+TEST(MemcacheBinaryEncoder, WritesIntoHeadroom) {
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheBinaryMessage>::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(MemcacheBinaryEncoder())
+    .finalize();
+
+  MemcacheBinaryMessage msg;
+  msg.magic = MemcacheBinaryMessage::Magic::RESPONSE;
+  msg.opcode = MemcacheBinaryMessage::Opcode::GETK;
+  msg.opaque = 0xdeadbeef;
+  msg.cas = 7;
+  msg.extras = IOBuf::copyBuffer("\x00\x00\x00\x01", 4);
+  msg.key = IOBuf::copyBuffer("foo");
+  msg.value = MemcacheBinaryEncoder::createValue(3);
+  memcpy(msg.value->writableTail(), "bar", 3);
+  msg.value->append(3);
+  auto value = msg.value->data();
+  pipeline->write(std::move(msg));
+
+  ASSERT_EQ(1, writes.bufs.size());
+  auto& out = writes.bufs[0];
+  EXPECT_FALSE(out->isChained());
+  EXPECT_EQ(value + 3, out->tail());
+  EXPECT_EQ(0, memcmp(kGetResponse, out->data(), sizeof(kGetResponse)));
+}
+
+TEST(MemcacheBinaryEncoder, ChainsLargeValues) {
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheBinaryMessage>::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(MemcacheBinaryEncoder())
+    .finalize();
+
+  MemcacheBinaryMessage msg;
+  msg.opcode = MemcacheBinaryMessage::Opcode::SET;
+  msg.key = IOBuf::copyBuffer("foo");
+  msg.value = IOBuf::copyBuffer(std::string(4096, 'x'));
+  auto value = msg.value->data();
+  pipeline->write(std::move(msg));
+
+  auto& out = writes.bufs[0];
+  EXPECT_EQ(27 + 4096, out->computeChainDataLength());
+  ASSERT_TRUE(out->isChained());
+  EXPECT_EQ(value, out->next()->data());
+
+  MessageCollector<MemcacheBinaryMessage> collector;
+  auto decoder = Pipeline<IOBufQueue&, MemcacheBinaryMessage>::create();
+  (*decoder)
+    .addBack(MemcacheBinaryDecoder())
+    .addBack(&collector)
+    .finalize();
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(out));
+  decoder->read(q);
+  ASSERT_EQ(1, collector.messages.size());
+  EXPECT_EQ(MemcacheBinaryMessage::Opcode::SET,
+            collector.messages[0].opcode);
+  EXPECT_EQ(4096, collector.messages[0].value->computeChainDataLength());
+}
+
+TEST(MemcacheMetaDecoder, Responses) {
+  MessageCollector<MemcacheMetaMessage> collector;
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheMetaMessage>::create();
+  (*pipeline)
+    .addBack(MemcacheMetaDecoder())
+    .addBack(&collector)
+    .finalize();
+
+  std::string data = "VA 5 f0 c12\r\nhello\r\nHD\r\nEN\r\nMN\r\n";
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  for (auto c : data) {
+    q.append(IOBuf::copyBuffer(&c, 1));
+    pipeline->read(q);
+  }
+
+  ASSERT_EQ(4, collector.messages.size());
+  auto& va = collector.messages[0];
+  EXPECT_EQ("VA", va.command);
+  ASSERT_EQ(2, va.flags.size());
+  EXPECT_EQ("f0", va.flags[0]);
+  EXPECT_EQ("c12", va.flags[1]);
+  EXPECT_EQ("hello", toString(va.value));
+  EXPECT_EQ("HD", collector.messages[1].command);
+  EXPECT_EQ("EN", collector.messages[2].command);
+  EXPECT_EQ("MN", collector.messages[3].command);
+}
+
+TEST(MemcacheMetaDecoder, Commands) {
+  MessageCollector<MemcacheMetaMessage> collector;
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheMetaMessage>::create();
+  (*pipeline)
+    .addBack(MemcacheMetaDecoder())
+    .addBack(&collector)
+    .finalize();
+
+  auto buf = IOBuf::copyBuffer(
+    "ms foo 5 T60\r\nhello\r\nmg foo v\r\nmn\r\nms foo 3\r\nbad data\r\n");
+  auto begin = buf->data();
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(buf));
+  pipeline->read(q);
+
+  ASSERT_EQ(3, collector.messages.size());
+  auto& ms = collector.messages[0];
+  EXPECT_EQ("foo", ms.key);
+  ASSERT_EQ(1, ms.flags.size());
+  EXPECT_EQ("T60", ms.flags[0]);
+  EXPECT_EQ(begin + 14, ms.value->data());
+  EXPECT_EQ("foo", collector.messages[1].key);
+  EXPECT_EQ("mn", collector.messages[2].command);
+  EXPECT_TRUE(collector.messages[2].key.empty());
+  EXPECT_EQ(1, collector.errors);
+}
+
+TEST(MemcacheMetaEncoder, Encode) {
+  auto pipeline = Pipeline<IOBufQueue&, MemcacheMetaMessage>::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(MemcacheMetaEncoder())
+    .finalize();
+
+  pipeline->write(MemcacheMetaMessage("mg", "foo", {"v", "t"}));
+  pipeline->write(
+    MemcacheMetaMessage("ms", "foo", {"T60"}, IOBuf::copyBuffer("hello")));
+
+  auto value = MemcacheBinaryEncoder::createValue(16);
+  memcpy(value->writableTail(), "world", 5);
+  value->append(5);
+  auto data = value->data();
+  pipeline->write(MemcacheMetaMessage("VA", "", {"f0"}, std::move(value)));
+
+  ASSERT_EQ(3, writes.bufs.size());
+  EXPECT_EQ("mg foo v t\r\n", toString(writes.bufs[0]));
+  EXPECT_EQ("ms foo 5 T60\r\nhello\r\n", toString(writes.bufs[1]));
+  EXPECT_EQ("VA 5 f0\r\nworld\r\n", toString(writes.bufs[2]));
+  EXPECT_FALSE(writes.bufs[2]->isChained());
+  EXPECT_EQ(data + 7, writes.bufs[2]->tail());
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <thread>
+
+#include <folly/Conv.h>
+#include <folly/Random.h>
+#include <folly/ScopeGuard.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/codec/LineBasedFrameDecoder.h>
+#include <wangle/codec/ParallelDecoder.h>
+#include <wangle/codec/StringCodec.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<std::string, std::string> FramePipeline;
+
+class IntCollector : public InboundHandler<int> {
+ public:
+  void read(Context*, int value) override {
+    values.push_back(value);
+  }
+
+  void readException(Context*, exception_wrapper) override {
+    values.push_back(-1);
+  }
+
+  void readEOF(Context*) override {
+    eof = true;
+  }
+
+  std::vector<int> values;
+  bool eof{false};
+};
+
+} // namespace
+
+TEST(ParallelDecoder, PreservesOrder) {
+  // Without a transport, results come back on the thread's EventBase
+  auto& evb = *EventBaseManager::get()->getEventBase();
+  auto executor = std::make_shared<CPUThreadPoolExecutor>(4);
+  IntCollector collector;
+  auto pipeline = FramePipeline::create();
+  pipeline->addBack(ParallelDecoder<std::string, int>(
+    executor,
+    [](std::string frame) {
+      // Finish out of order
+      /* sleep override */
+      std::this_thread::sleep_for(
+        std::chrono::microseconds(Random::rand32(1000)));
+      if (frame == "bad") {
+        throw std::runtime_error("bad frame");
+      }
+      return folly::to<int>(frame);
+    },
+    8));
+  pipeline->addBack(&collector);
+  pipeline->finalize();
+
+  std::vector<int> expected;
+  for (int i = 0; i < 100; i++) {
+    if (i == 50) {
+      pipeline->read("bad");
+      expected.push_back(-1);
+    } else {
+      pipeline->read(folly::to<std::string>(i));
+      expected.push_back(i);
+    }
+  }
+  pipeline->readEOF();
+  EXPECT_FALSE(collector.eof);
+
+  while (collector.values.size() < expected.size()) {
+    evb.loopOnce();
+  }
+  EXPECT_EQ(expected, collector.values);
+  EXPECT_TRUE(collector.eof);
+}
+
+TEST(ParallelDecoder, PausesReads) {
+  EventBase evb;
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  auto socket = AsyncSocket::newSocket(&evb, NetworkSocket::fromFd(fds[0]));
+  SCOPE_EXIT {
+    ::close(fds[1]);
+  };
+
+  auto executor = std::make_shared<ManualExecutor>();
+  IntCollector collector;
+  auto pipeline = Pipeline<IOBufQueue&, std::string>::create();
+  pipeline->addBack(AsyncSocketHandler(socket));
+  pipeline->addBack(LineBasedFrameDecoder());
+  pipeline->addBack(StringCodec());
+  pipeline->addBack(ParallelDecoder<std::string, int>(
+    executor,
+    [](std::string frame) { return folly::to<int>(frame); },
+    2));
+  pipeline->addBack(&collector);
+  pipeline->finalize();
+  pipeline->transportActive();
+  auto handler = pipeline->getHandler<AsyncSocketHandler>();
+  auto decoder = pipeline->getHandler<ParallelDecoder<std::string, int>>();
+  EXPECT_EQ(handler, socket->getReadCallback());
+
+  // One socket read delivers all three frames; the third waits for a slot
+  ASSERT_EQ(6, ::write(fds[1], "0\n1\n2\n", 6));
+  while (decoder->getOutstanding() < 3) {
+    evb.loopOnce();
+  }
+  EXPECT_EQ(nullptr, socket->getReadCallback());
+
+  // Not read while paused
+  ASSERT_EQ(2, ::write(fds[1], "3\n", 2));
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(3, decoder->getOutstanding());
+
+  // Only two decodes were started
+  EXPECT_EQ(2, executor->run());
+  while (collector.values.size() < 4) {
+    executor->run();
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3}), collector.values);
+  EXPECT_EQ(handler, socket->getReadCallback());
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <wangle/codec/RedisCodec.h>
+#include <wangle/codec/test/CodecTestUtils.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<IOBufQueue&, RedisValue> RedisPipeline;
+
+class ValueCollector : public InboundHandler<RedisValue> {
+ public:
+  void read(Context*, RedisValue value) override {
+    values.push_back(std::move(value));
+  }
+
+  void readException(Context*, exception_wrapper) override {
+    errors++;
+  }
+
+  std::vector<RedisValue> values;
+  int errors{0};
+};
+
+RedisPipeline::Ptr makePipeline(ValueCollector& collector) {
+  auto pipeline = RedisPipeline::create();
+  (*pipeline)
+    .addBack(RedisDecoder())
+    .addBack(&collector)
+    .finalize();
+  return pipeline;
+}
+
+} // namespace
+
+TEST(RedisDecoder, PipelinedCommands) {
+  ValueCollector collector;
+  auto pipeline = makePipeline(collector);
+
+  auto data = IOBuf::copyBuffer(
+    "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n"
+    "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n");
+  auto begin = data->data();
+  auto end = begin + data->length();
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(std::move(data));
+  pipeline->read(q);
+
+  ASSERT_EQ(2, collector.values.size());
+  EXPECT_EQ(0, q.chainLength());
+
+  auto& set = collector.values[0];
+  ASSERT_EQ(RedisValue::Type::ARRAY, set.type);
+  ASSERT_EQ(3, set.elements.size());
+  EXPECT_EQ("SET", set.elements[0].asString());
+  EXPECT_EQ("value", set.elements[2].asString());
+  // bulk strings are slices of the read buffer
+  EXPECT_TRUE(set.elements[2].data->data() >= begin &&
+              set.elements[2].data->tail() <= end);
+
+  EXPECT_EQ("GET", collector.values[1].elements[0].asString());
+}
+
+TEST(RedisDecoder, Incremental) {
+  ValueCollector collector;
+  auto pipeline = makePipeline(collector);
+
+  std::string data =
+    "*3\r\n:1\r\n*2\r\n$5\r\nhello\r\n$-1\r\n+OK\r\n"
+    "-ERR bad\r\n";
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  for (auto c : data) {
+    q.append(IOBuf::copyBuffer(&c, 1));
+    pipeline->read(q);
+  }
+
+  ASSERT_EQ(2, collector.values.size());
+  auto& array = collector.values[0];
+  ASSERT_EQ(3, array.elements.size());
+  EXPECT_EQ(1, array.elements[0].integer);
+  ASSERT_EQ(RedisValue::Type::ARRAY, array.elements[1].type);
+  EXPECT_EQ("hello", array.elements[1].elements[0].asString());
+  EXPECT_TRUE(array.elements[1].elements[1].isNull());
+  EXPECT_EQ(RedisValue::Type::SIMPLE_STRING, array.elements[2].type);
+  EXPECT_EQ("OK", array.elements[2].asString());
+
+  EXPECT_EQ(RedisValue::Type::ERROR, collector.values[1].type);
+  EXPECT_EQ("ERR bad", collector.values[1].asString());
+}
+
+TEST(RedisDecoder, Resp3) {
+  ValueCollector collector;
+  auto pipeline = makePipeline(collector);
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::copyBuffer(
+    "%1\r\n+key\r\n~2\r\n#t\r\n,1.5\r\n"
+    "_\r\n"
+    "=8\r\ntxt:text\r\n"
+    "(12345678901234567890\r\n"));
+  pipeline->read(q);
+
+  ASSERT_EQ(4, collector.values.size());
+  auto& map = collector.values[0];
+  ASSERT_EQ(RedisValue::Type::MAP, map.type);
+  ASSERT_EQ(2, map.elements.size());
+  EXPECT_EQ("key", map.elements[0].asString());
+  auto& set = map.elements[1];
+  ASSERT_EQ(RedisValue::Type::SET, set.type);
+  EXPECT_TRUE(set.elements[0].boolean);
+  EXPECT_EQ(1.5, set.elements[1].doubleValue);
+
+  EXPECT_TRUE(collector.values[1].isNull());
+  EXPECT_EQ(RedisValue::Type::VERBATIM_STRING, collector.values[2].type);
+  EXPECT_EQ("txt:text", collector.values[2].asString());
+  EXPECT_EQ("12345678901234567890", collector.values[3].asString());
+}
+
+TEST(RedisDecoder, Malformed) {
+  ValueCollector collector;
+  auto pipeline = makePipeline(collector);
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::copyBuffer("*1\r\n$3\r\nabcd\r\n"));
+  pipeline->read(q);
+  EXPECT_EQ(0, collector.values.size());
+  EXPECT_EQ(1, collector.errors);
+  EXPECT_EQ(0, q.chainLength());
+
+  // The decoder starts over after an error
+  q.append(IOBuf::copyBuffer(":42\r\n"));
+  pipeline->read(q);
+  ASSERT_EQ(1, collector.values.size());
+  EXPECT_EQ(42, collector.values[0].integer);
+}
+
+TEST(RedisEncoder, RoundTrip) {
+  auto pipeline = RedisPipeline::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(RedisEncoder())
+    .finalize();
+
+  pipeline->write(RedisValue::command({"SET", "key", "value"}));
+  pipeline->write(RedisValue::integerValue(-7));
+  pipeline->write(RedisValue());
+  RedisValue b(RedisValue::Type::BOOLEAN);
+  b.boolean = true;
+  pipeline->write(std::move(b));
+
+  EXPECT_EQ(
+    "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n"
+    ":-7\r\n"
+    "$-1\r\n"
+    ":1\r\n",
+    writes.str());
+
+  ValueCollector collector;
+  auto decoder = makePipeline(collector);
+  decoder->read(writes.out);
+  ASSERT_EQ(4, collector.values.size());
+  EXPECT_EQ("value", collector.values[0].elements[2].asString());
+  EXPECT_EQ(-7, collector.values[1].integer);
+}
+
+TEST(RedisEncoder, LargeBulkIsChained) {
+  auto pipeline = RedisPipeline::create();
+  test::BytesCollector writes;
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(RedisEncoder(3))
+    .finalize();
+
+  auto payload = IOBuf::copyBuffer(std::string(4096, 'x'));
+  auto data = payload->data();
+  pipeline->write(RedisValue::bulkString(std::move(payload)));
+
+  auto out = writes.out.move();
+  EXPECT_EQ(4096 + 9, out->computeChainDataLength());
+  bool found = false;
+  for (auto range : *out) {
+    found = found || range.data() == data;
+  }
+  EXPECT_TRUE(found);
+}
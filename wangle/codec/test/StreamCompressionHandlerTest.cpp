@@ -0,0 +1,159 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Random.h>
+#include <folly/io/Cursor.h>
+#include <folly/portability/GTest.h>
+
+#include <wangle/codec/StreamCompressionHandler.h>
+#include <wangle/codec/test/CodecTestUtils.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<IOBufQueue&, std::unique_ptr<IOBuf>> BytesPipeline;
+
+class ReadCollector : public InboundBytesToBytesHandler {
+ public:
+  void read(Context*, IOBufQueue& q) override {
+    auto buf = q.move();
+    if (buf) {
+      data += buf->moveToFbString().toStdString();
+    }
+  }
+
+  void readException(Context*, exception_wrapper) override {
+    errors++;
+  }
+
+  std::string data;
+  int errors{0};
+};
+
+struct Endpoint {
+  explicit Endpoint(StreamCompressionOptions options) {
+    pipeline = BytesPipeline::create();
+    (*pipeline)
+      .addBack(&writes)
+      .addBack(StreamCompressionHandler(std::move(options)))
+      .addBack(&reads)
+      .finalize();
+  }
+
+  test::BytesCollector writes;
+  ReadCollector reads;
+  BytesPipeline::Ptr pipeline;
+};
+
+StreamCompressionOptions zlibOptions() {
+  StreamCompressionOptions options;
+  options.type = io::CodecType::ZLIB;
+  return options;
+}
+
+std::string randomBytes(size_t length) {
+  std::string data(length, '\0');
+  for (auto& c : data) {
+    c = Random::rand32();
+  }
+  return data;
+}
+
+const std::string kMessage =
+  "{\"user\":\"someone\",\"items\":[1,2,3,4,5],\"status\":\"active\"}";
+
+} // namespace
+
+TEST(StreamCompressionHandler, RoundTrip) {
+  if (!io::hasStreamCodec(io::CodecType::ZLIB)) {
+    return;
+  }
+  Endpoint client(zlibOptions()), server(zlibOptions());
+
+  std::string sent;
+  for (int i = 0; i < 100; i++) {
+    sent += kMessage;
+    client.pipeline->write(IOBuf::copyBuffer(kMessage));
+  }
+  // Later messages compress against earlier ones
+  EXPECT_LT(client.writes.out.chainLength(), sent.size() / 4);
+
+  // Deliver the bytes a few at a time
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  auto wire = client.writes.out.move();
+  io::Cursor c(wire.get());
+  while (!c.isAtEnd()) {
+    std::unique_ptr<IOBuf> piece;
+    c.clone(piece, std::min<size_t>(7, c.totalLength()));
+    q.append(std::move(piece));
+    server.pipeline->read(q);
+  }
+  EXPECT_EQ(sent, server.reads.data);
+  EXPECT_EQ(0, server.reads.errors);
+}
+
+TEST(StreamCompressionHandler, Bypass) {
+  if (!io::hasStreamCodec(io::CodecType::ZLIB)) {
+    return;
+  }
+  Endpoint client(zlibOptions()), server(zlibOptions());
+
+  auto random = randomBytes(4096);
+  EXPECT_TRUE(
+    StreamCompressionHandler::looksIncompressible(*IOBuf::copyBuffer(random)));
+  client.pipeline->write(IOBuf::copyBuffer(random));
+  // Sent as a single raw frame
+  EXPECT_EQ(random.size() + 5, client.writes.out.chainLength());
+  EXPECT_EQ(0, client.writes.out.front()->data()[0]);
+
+  client.pipeline->write(IOBuf::copyBuffer("short"));
+  client.pipeline->write(IOBuf::copyBuffer(kMessage + kMessage));
+  server.pipeline->read(client.writes.out);
+  EXPECT_EQ(random + "short" + kMessage + kMessage, server.reads.data);
+}
+
+TEST(StreamCompressionHandler, Dictionary) {
+  if (!io::hasStreamCodec(io::CodecType::ZLIB)) {
+    return;
+  }
+  auto options = zlibOptions();
+  options.dictionary = kMessage;
+  Endpoint client(options), server(options), plain(zlibOptions());
+
+  client.pipeline->write(IOBuf::copyBuffer(kMessage));
+  plain.pipeline->write(IOBuf::copyBuffer(kMessage));
+  EXPECT_LT(client.writes.out.chainLength(), plain.writes.out.chainLength());
+
+  server.pipeline->read(client.writes.out);
+  EXPECT_EQ(kMessage, server.reads.data);
+}
+
+TEST(StreamCompressionHandler, Corrupt) {
+  if (!io::hasStreamCodec(io::CodecType::ZLIB)) {
+    return;
+  }
+  Endpoint server(zlibOptions());
+
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::copyBuffer(std::string("\x01\x00\x00\x00\x04", 5) +
+                             "junk"));
+  server.pipeline->read(q);
+  EXPECT_EQ(1, server.reads.errors);
+  EXPECT_EQ(0, q.chainLength());
+  EXPECT_EQ("", server.reads.data);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/portability/GFlags.h>
+#include <wangle/codec/WebSocketCodec.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+const std::array<uint8_t, 4> kKey{{0x37, 0xfa, 0x21, 0x3d}};
+
+void byteLoop(uint32_t iters, size_t length) {
+  std::vector<uint8_t> data(length);
+  for (uint32_t i = 0; i < iters; i++) {
+    for (size_t j = 0; j < length; j++) {
+      data[j] ^= kKey[j & 3];
+    }
+    doNotOptimizeAway(data.data());
+  }
+}
+
+void applyMask(uint32_t iters, size_t length) {
+  std::vector<uint8_t> data(length);
+  for (uint32_t i = 0; i < iters; i++) {
+    applyWebSocketMask(data.data(), length, kKey);
+    doNotOptimizeAway(data.data());
+  }
+}
+
+} // namespace
+
+BENCHMARK_PARAM(byteLoop, 64)
+BENCHMARK_RELATIVE_PARAM(applyMask, 64)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(byteLoop, 1024)
+BENCHMARK_RELATIVE_PARAM(applyMask, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(byteLoop, 65536)
+BENCHMARK_RELATIVE_PARAM(applyMask, 65536)
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
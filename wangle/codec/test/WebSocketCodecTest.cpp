@@ -0,0 +1,219 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <wangle/codec/WebSocketCodec.h>
+#include <wangle/codec/test/CodecTestUtils.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<IOBufQueue&, WebSocketMessage> WebSocketPipeline;
+typedef WebSocketMessage::Opcode Opcode;
+
+class MessageCollector : public InboundHandler<WebSocketMessage> {
+ public:
+  void read(Context*, WebSocketMessage msg) override {
+    messages.push_back(std::move(msg));
+  }
+
+  void readException(Context*, exception_wrapper) override {
+    errors++;
+  }
+
+  std::vector<WebSocketMessage> messages;
+  int errors{0};
+};
+
+// "Compresses" by prepending a marker, so tests can see it was applied
+class PrefixCompressor : public WebSocketCompressor {
+ public:
+  std::unique_ptr<IOBuf> compress(const IOBuf& payload) override {
+    if (payload.computeChainDataLength() < 4) {
+      return nullptr;
+    }
+    auto out = IOBuf::copyBuffer("z:");
+    out->prependChain(payload.clone());
+    return out;
+  }
+
+  std::unique_ptr<IOBuf> decompress(std::unique_ptr<IOBuf> payload) override {
+    if (payload->computeChainDataLength() < 2) {
+      throw std::runtime_error("corrupt");
+    }
+    payload->coalesce();
+    payload->trimStart(2);
+    return payload;
+  }
+};
+
+std::string toString(const std::unique_ptr<IOBuf>& buf) {
+  return buf ? buf->clone()->moveToFbString().toStdString() : "";
+}
+
+// A masked client frame
+std::string frame(uint8_t b0, StringPiece payload) {
+  std::array<uint8_t, 4> key{{0x37, 0xfa, 0x21, 0x3d}};
+  std::string out;
+  out += char(b0);
+  out += char(0x80 | payload.size());
+  out.append(reinterpret_cast<const char*>(key.data()), key.size());
+  auto begin = out.size();
+  out += payload.str();
+  applyWebSocketMask(
+    reinterpret_cast<uint8_t*>(&out[begin]), payload.size(), key);
+  return out;
+}
+
+WebSocketPipeline::Ptr makePipeline(WebSocketCodec codec,
+                                    test::BytesCollector& writes,
+                                    MessageCollector& reads) {
+  auto pipeline = WebSocketPipeline::create();
+  (*pipeline)
+    .addBack(&writes)
+    .addBack(std::move(codec))
+    .addBack(&reads)
+    .finalize();
+  return pipeline;
+}
+
+} // namespace
+
+TEST(WebSocketMask, MatchesByteLoop) {
+  std::array<uint8_t, 4> key{{0x01, 0x23, 0x45, 0x67}};
+  for (size_t length : {0, 1, 7, 8, 15, 16, 31, 32, 33, 100, 1000}) {
+    for (size_t offset = 0; offset < 4; offset++) {
+      std::vector<uint8_t> data(length), expected(length);
+      for (size_t i = 0; i < length; i++) {
+        data[i] = i * 7;
+        expected[i] = data[i] ^ key[(offset + i) & 3];
+      }
+      applyWebSocketMask(data.data(), length, key, offset);
+      EXPECT_EQ(expected, data) << length << " " << offset;
+    }
+  }
+}
+
+TEST(WebSocketCodec, FragmentsAndControlFrames) {
+  test::BytesCollector writes;
+  MessageCollector reads;
+  auto pipeline = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::SERVER), writes, reads);
+
+  std::string data = frame(0x01, "Hel") + frame(0x89, "ping") +
+    frame(0x00, "lo, ") + frame(0x80, "world") + frame(0x82, "bin") +
+    frame(0x88, "\x03\xe8");
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  for (auto c : data) {
+    q.append(IOBuf::copyBuffer(&c, 1));
+    pipeline->read(q);
+  }
+
+  ASSERT_EQ(4, reads.messages.size());
+  EXPECT_EQ(0, reads.errors);
+  EXPECT_EQ(Opcode::PING, reads.messages[0].opcode);
+  EXPECT_EQ("ping", toString(reads.messages[0].payload));
+  EXPECT_EQ(Opcode::TEXT, reads.messages[1].opcode);
+  EXPECT_EQ("Hello, world", toString(reads.messages[1].payload));
+  EXPECT_EQ(Opcode::BINARY, reads.messages[2].opcode);
+  EXPECT_EQ("bin", toString(reads.messages[2].payload));
+  EXPECT_EQ(Opcode::CLOSE, reads.messages[3].opcode);
+  EXPECT_EQ(1000, reads.messages[3].closeCode());
+}
+
+TEST(WebSocketCodec, ProtocolErrors) {
+  test::BytesCollector writes;
+  MessageCollector reads;
+  auto pipeline = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::SERVER), writes, reads);
+
+  // An unmasked frame from a client
+  IOBufQueue q(IOBufQueue::cacheChainLength());
+  q.append(IOBuf::copyBuffer("\x82\x03" "abc"));
+  pipeline->read(q);
+  EXPECT_EQ(0, reads.messages.size());
+  EXPECT_EQ(1, reads.errors);
+  EXPECT_EQ(0, q.chainLength());
+
+  test::BytesCollector writes2;
+  MessageCollector reads2;
+  auto pipeline2 = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::SERVER), writes2, reads2);
+  // A continuation frame with nothing to continue
+  q.append(IOBuf::copyBuffer(frame(0x80, "abc")));
+  pipeline2->read(q);
+  EXPECT_EQ(1, reads2.errors);
+}
+
+TEST(WebSocketCodec, ClientToServer) {
+  test::BytesCollector clientWrites;
+  MessageCollector clientReads;
+  auto client = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::CLIENT),
+    clientWrites, clientReads);
+
+  auto big = IOBuf::copyBuffer(std::string(70000, 'x'));
+  auto bigData = big->data();
+  client->write(WebSocketMessage::text("hello"));
+  client->write(WebSocketMessage::binary(big->clone()));
+  client->write(WebSocketMessage::close(1001, "bye"));
+  // The caller's buffer is not masked in place
+  EXPECT_EQ('x', bigData[0]);
+
+  test::BytesCollector serverWrites;
+  MessageCollector serverReads;
+  auto server = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::SERVER),
+    serverWrites, serverReads);
+  server->read(clientWrites.out);
+  ASSERT_EQ(3, serverReads.messages.size());
+  EXPECT_EQ("hello", toString(serverReads.messages[0].payload));
+  EXPECT_EQ(70000,
+            serverReads.messages[1].payload->computeChainDataLength());
+  EXPECT_EQ(1001, serverReads.messages[2].closeCode());
+
+  // Server frames are not masked
+  server->write(WebSocketMessage::text("hi"));
+  EXPECT_EQ("\x81\x02hi",
+            serverWrites.out.move()->moveToFbString().toStdString());
+}
+
+TEST(WebSocketCodec, Compression) {
+  auto compressor = std::make_shared<PrefixCompressor>();
+  test::BytesCollector clientWrites;
+  MessageCollector clientReads;
+  auto client = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::CLIENT, 1024, compressor),
+    clientWrites, clientReads);
+  test::BytesCollector serverWrites;
+  MessageCollector serverReads;
+  auto server = makePipeline(
+    WebSocketCodec(WebSocketCodec::Direction::SERVER, 1024, compressor),
+    serverWrites, serverReads);
+
+  client->write(WebSocketMessage::text("compressed"));
+  client->write(WebSocketMessage::text("raw"));
+  // RSV1 is set only on the compressed message
+  EXPECT_EQ(0xc1, clientWrites.out.front()->data()[0]);
+
+  server->read(clientWrites.out);
+  ASSERT_EQ(2, serverReads.messages.size());
+  EXPECT_EQ("compressed", toString(serverReads.messages[0].payload));
+  EXPECT_EQ("raw", toString(serverReads.messages[1].payload));
+}
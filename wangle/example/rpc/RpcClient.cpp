@@ -117,8 +117,17 @@ int main(int argc, char** argv) {
   auto dispatcher = std::make_shared<BonkMultiplexClientDispatcher>();
   dispatcher->setPipeline(pipeline);
 
-  // Set an idle timeout of 5s using a filter.
-  ExpiringFilter<Bonk, Xtruct> service(dispatcher, std::chrono::seconds(5));
+  // Set an idle timeout of 5s using a filter. Its timers run on the
+  // connection's EventBase, so it is created, called and destroyed there.
+  auto evb = pipeline->getTransport()->getEventBase();
+  std::shared_ptr<ExpiringFilter<Bonk, Xtruct>> service;
+  evb->runInEventBaseThreadAndWait([&] {
+    service = std::make_shared<ExpiringFilter<Bonk, Xtruct>>(
+        dispatcher,
+        std::chrono::seconds(5),
+        std::chrono::milliseconds(0),
+        evb);
+  });
 
   try {
     while (true) {
@@ -127,14 +136,16 @@ int main(int argc, char** argv) {
       Bonk request;
       std::cin >> request.message;
       std::cin >> request.type;
-      service(request).thenValue([request](Xtruct response) {
-        CHECK(request.type == response.i32_thing);
-        std::cout << response.string_thing << std::endl;
-      });
+      folly::via(evb, [service, request] { return (*service)(request); })
+          .thenValue([request](Xtruct response) {
+            CHECK(request.type == response.i32_thing);
+            std::cout << response.string_thing << std::endl;
+          });
     }
   } catch (const std::exception& e) {
     std::cout << exceptionStr(e) << std::endl;
   }
+  evb->runInEventBaseThreadAndWait([&] { service.reset(); });
 
   return 0;
 }
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * A service filter that collects individual requests into batches for a
+ * service taking a vector of requests and returning a vector of responses,
+ * the i-th response answering the i-th request.
+ *
+ * A batch is sent once it has maxBatchSize requests, or maxDelay after its
+ * first request.  With no maxDelay, it is sent at the end of the current
+ * iteration of the event loop, which groups everything issued in response
+ * to the same network events without adding latency.  Delays use an
+ * AsyncTimeout on evb rather than its HHWheelTimer, whose 10ms tick would
+ * dwarf the sub-millisecond delays batching usually wants.
+ *
+ * If the batch fails, or returns the wrong number of responses, every
+ * request in it fails.  Requests must be made from evb's thread (by default
+ * the EventBase of the creating thread).
+ */
+template <typename Req, typename Resp = Req>
+class BatchingFilter
+    : public ServiceFilter<Req, Resp, std::vector<Req>, std::vector<Resp>> {
+ public:
+  explicit BatchingFilter(
+      std::shared_ptr<Service<std::vector<Req>, std::vector<Resp>>> service,
+      size_t maxBatchSize = 64,
+      std::chrono::microseconds maxDelay = std::chrono::microseconds(0),
+      folly::EventBase* evb = nullptr)
+      : ServiceFilter<Req, Resp, std::vector<Req>, std::vector<Resp>>(service)
+      , maxBatchSize_(maxBatchSize)
+      , maxDelay_(maxDelay)
+      , evb_(evb ? evb : folly::EventBaseManager::get()->getEventBase())
+      , flusher_(this, evb_) {
+    CHECK_GT(maxBatchSize_, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    DCHECK(evb_->isInEventBaseThread());
+    requests_.push_back(std::move(req));
+    promises_.emplace_back();
+    auto f = promises_.back().getFuture();
+    if (requests_.size() >= maxBatchSize_) {
+      flush();
+    } else if (requests_.size() == 1) {
+      if (maxDelay_.count() > 0) {
+        flusher_.scheduleTimeoutHighRes(maxDelay_);
+      } else {
+        evb_->runInLoop(&flusher_);
+      }
+    }
+    return f;
+  }
+
+  folly::Future<folly::Unit> close() override {
+    flush();
+    return this->service_->close();
+  }
+
+  /**
+   * Sends the requests collected so far.
+   */
+  void flush() {
+    flusher_.cancelTimeout();
+    flusher_.cancelLoopCallback();
+    if (requests_.empty()) {
+      return;
+    }
+
+    auto promises = std::move(promises_);
+    promises_.clear();
+    auto requests = std::move(requests_);
+    requests_.clear();
+    (*this->service_)(std::move(requests))
+      .thenTry([promises = std::move(promises)](
+                   folly::Try<std::vector<Resp>> t) mutable {
+        if (t.hasValue() && t.value().size() != promises.size()) {
+          t = folly::Try<std::vector<Resp>>(
+            folly::make_exception_wrapper<std::runtime_error>(
+              "Batch response size mismatch"));
+        }
+        if (t.hasException()) {
+          for (auto& p : promises) {
+            p.setException(t.exception());
+          }
+          return;
+        }
+        for (size_t i = 0; i < promises.size(); i++) {
+          promises[i].setValue(std::move(t.value()[i]));
+        }
+      });
+  }
+
+ private:
+  class Flusher : public folly::AsyncTimeout,
+                  public folly::EventBase::LoopCallback {
+   public:
+    Flusher(BatchingFilter* filter, folly::EventBase* evb)
+        : folly::AsyncTimeout(evb), filter_(filter) {}
+
+    void timeoutExpired() noexcept override {
+      filter_->flush();
+    }
+
+    void runLoopCallback() noexcept override {
+      filter_->flush();
+    }
+
+   private:
+    BatchingFilter* filter_;
+  };
+
+  size_t maxBatchSize_;
+  std::chrono::microseconds maxDelay_;
+  folly::EventBase* evb_;
+  std::vector<Req> requests_;
+  std::vector<folly::Promise<Resp>> promises_;
+  Flusher flusher_;
+};
+
+} // namespace wangle
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/hash/Hash.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+struct CachingFilterOptions {
+  /**
+   * How long a response answers requests without asking the service.
+   */
+  std::chrono::milliseconds ttl{1000};
+
+  /**
+   * How long after the ttl a response may still be returned, while one
+   * request refreshes it from the service in the background.
+   */
+  std::chrono::milliseconds staleTtl{0};
+
+  /**
+   * The most bytes of responses to keep, as measured by the filter's size
+   * function, split evenly between shards.  The least recently used
+   * responses are evicted past it.
+   */
+  size_t maxBytes{64 * 1024 * 1024};
+
+  size_t numShards{16};
+};
+
+/**
+ * A service filter that caches successful responses by a key of the
+ * request, for read mostly services.  Cached responses are copied to each
+ * caller, so Resp must be copyable, and are expected to be cheap to copy,
+ * such as a shared_ptr.
+ *
+ * The cache is split into shards by key hash, each an LRU map with its own
+ * lock, as in LRUInMemoryCache.  Concurrent misses for a key each reach the
+ * service; put a SingleFlightFilter behind this filter to combine them.
+ */
+template <typename Req, typename Resp = Req, typename Key = Req>
+class CachingFilter : public ServiceFilter<Req, Resp> {
+ public:
+  CachingFilter(
+      std::shared_ptr<Service<Req, Resp>> service,
+      std::function<Key(const Req&)> getKey,
+      std::function<size_t(const Resp&)> getSize =
+          [](const Resp&) { return sizeof(Resp); },
+      CachingFilterOptions options = {})
+      : ServiceFilter<Req, Resp>(service)
+      , getKey_(std::move(getKey))
+      , state_(std::make_shared<State>(std::move(getSize), options)) {
+    CHECK(getKey_);
+    CHECK(state_->getSize);
+    CHECK_GT(options.numShards, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    auto key = getKey_(req);
+    auto index = folly::hasher<Key>()(key) % state_->shards.size();
+    auto& shard = state_->shards[index];
+    auto now = std::chrono::steady_clock::now();
+    {
+      std::unique_lock<std::mutex> g(shard.mutex);
+      auto it = shard.cache.find(key);
+      if (it != shard.cache.end()) {
+        auto& entry = it->second;
+        if (now < entry.freshUntil) {
+          state_->hits++;
+          return entry.resp;
+        }
+        if (now < entry.staleUntil) {
+          state_->staleHits++;
+          Resp resp = entry.resp;
+          if (!entry.refreshing) {
+            entry.refreshing = true;
+            g.unlock();
+            fetch(std::move(req), std::move(key), index);
+          }
+          return resp;
+        }
+        shard.bytes -= entry.bytes;
+        shard.cache.erase(key);
+      }
+    }
+
+    state_->misses++;
+    return fetch(std::move(req), std::move(key), index);
+  }
+
+  uint64_t getHits() const {
+    return state_->hits;
+  }
+
+  /**
+   * Requests answered with a response past its ttl.
+   */
+  uint64_t getStaleHits() const {
+    return state_->staleHits;
+  }
+
+  uint64_t getMisses() const {
+    return state_->misses;
+  }
+
+  /**
+   * The bytes of responses cached.
+   */
+  size_t getBytes() const {
+    size_t bytes = 0;
+    for (auto& shard : state_->shards) {
+      std::lock_guard<std::mutex> g(shard.mutex);
+      bytes += shard.bytes;
+    }
+    return bytes;
+  }
+
+ private:
+  struct Entry {
+    Resp resp;
+    size_t bytes;
+    std::chrono::steady_clock::time_point freshUntil;
+    std::chrono::steady_clock::time_point staleUntil;
+    bool refreshing{false};
+  };
+
+  struct Shard {
+    Shard() : cache(0) {}
+
+    mutable std::mutex mutex;
+    folly::EvictingCacheMap<Key, Entry> cache;
+    size_t bytes{0};
+  };
+
+  // Shared with outstanding requests, which may outlive the filter
+  struct State {
+    State(std::function<size_t(const Resp&)> size, CachingFilterOptions opts)
+        : getSize(std::move(size))
+        , options(opts)
+        , shards(opts.numShards)
+        , maxShardBytes(opts.maxBytes / opts.numShards) {}
+
+    void store(size_t index, const Key& key, folly::Try<Resp>& t) {
+      auto& shard = shards[index];
+      std::lock_guard<std::mutex> g(shard.mutex);
+      auto it = shard.cache.findWithoutPromotion(key);
+      if (it != shard.cache.end()) {
+        shard.bytes -= it->second.bytes;
+        shard.cache.erase(key);
+      }
+      // Failures are not cached, and drop any stale response
+      if (t.hasException()) {
+        return;
+      }
+
+      auto bytes = getSize(t.value());
+      if (bytes > maxShardBytes) {
+        return;
+      }
+      while (shard.bytes + bytes > maxShardBytes) {
+        auto lru = shard.cache.rbegin();
+        shard.bytes -= lru->second.bytes;
+        shard.cache.erase(lru->first);
+      }
+      auto now = std::chrono::steady_clock::now();
+      shard.cache.set(
+        key,
+        Entry{t.value(),
+              bytes,
+              now + options.ttl,
+              now + options.ttl + options.staleTtl});
+      shard.bytes += bytes;
+    }
+
+    std::function<size_t(const Resp&)> getSize;
+    CachingFilterOptions options;
+    std::vector<Shard> shards;
+    size_t maxShardBytes;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> staleHits{0};
+    std::atomic<uint64_t> misses{0};
+  };
+
+  folly::Future<Resp> fetch(Req req, Key key, size_t index) {
+    return (*this->service_)(std::move(req))
+      .thenTry([state = state_, key = std::move(key), index](
+                   folly::Try<Resp> t) {
+        state->store(index, key, t);
+        return folly::makeFuture(std::move(t));
+      });
+  }
+
+  std::function<Key(const Req&)> getKey_;
+  std::shared_ptr<State> state_;
+};
+
+} // namespace wangle
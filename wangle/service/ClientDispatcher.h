@@ -16,7 +16,12 @@
 
 #pragma once
 
+#include <folly/container/F14Map.h>
+#include <folly/io/async/AsyncSocketException.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/HHWheelTimer.h>
 #include <wangle/channel/Handler.h>
+#include <wangle/service/Deadline.h>
 #include <wangle/service/Service.h>
 
 namespace wangle {
@@ -124,10 +129,125 @@ class PipelinedClientDispatcher
   std::deque<folly::Promise<Resp>> p_;
 };
 
-/*
- * A full out-of-order request/response client would require some sort
- * of sequence id on the wire.  Currently this is left up to
- * individual protocol writers to implement.
+/**
+ * Dispatch requests concurrently over a protocol that tags each message
+ * with a request id, matching responses to requests by id so that they
+ * may arrive in any order (e.g. from a MultiplexServerDispatcher).
+ *
+ * The protocol plugs in through setRequestId, which stamps the id the
+ * dispatcher assigns onto a request, and getRequestId, which reads it back
+ * from a response.  Responses with unknown ids, such as late responses to
+ * requests that timed out, are dropped.  When the connection closes or
+ * fails, all outstanding requests fail.
+ *
+ * With a non-zero timeout, or a Deadline on the request, requests not
+ * answered in time fail with folly::FutureTimeout; timeouts run on the
+ * HHWheelTimer of the pipeline's EventBase.  Like the other dispatchers,
+ * this must be used from the pipeline's EventBase thread.
  */
+template <typename Pipeline, typename Req, typename Resp = Req>
+class MultiplexClientDispatcher
+    : public ClientDispatcherBase<Pipeline, Req, Resp> {
+ public:
+  typedef typename HandlerAdapter<Resp, Req>::Context Context;
+
+  MultiplexClientDispatcher(
+      std::function<void(Req&, uint64_t)> setRequestId,
+      std::function<uint64_t(const Resp&)> getRequestId,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+      : setRequestId_(std::move(setRequestId))
+      , getRequestId_(std::move(getRequestId))
+      , timeout_(timeout) {}
+
+  void read(Context*, Resp in) override {
+    auto it = pending_.find(getRequestId_(in));
+    if (it == pending_.end()) {
+      return;
+    }
+    auto p = std::move(it->second.promise);
+    pending_.erase(it);
+    p.setValue(std::move(in));
+  }
+
+  void readEOF(Context* ctx) override {
+    failAll(folly::make_exception_wrapper<folly::AsyncSocketException>(
+      folly::AsyncSocketException::END_OF_FILE, "Connection closed"));
+    ctx->fireReadEOF();
+  }
+
+  void readException(Context* ctx, folly::exception_wrapper e) override {
+    failAll(e);
+    ctx->fireReadException(std::move(e));
+  }
+
+  folly::Future<Resp> operator()(Req arg) override {
+    DCHECK(this->pipeline_);
+
+    auto id = nextRequestId_++;
+    setRequestId_(arg, id);
+    auto& pending = pending_[id];
+    auto f = pending.promise.getFuture();
+    auto timeout = Deadline::bound(timeout_);
+    if (timeout.count() > 0) {
+      pending.timeout = std::make_unique<RequestTimeout>(this, id);
+      getEventBase()->timer().scheduleTimeout(pending.timeout.get(), timeout);
+    }
+    this->pipeline_->write(std::move(arg));
+    return f;
+  }
+
+  size_t getOutstanding() const {
+    return pending_.size();
+  }
+
+ private:
+  class RequestTimeout : public folly::HHWheelTimer::Callback {
+   public:
+    RequestTimeout(MultiplexClientDispatcher* dispatcher, uint64_t id)
+        : dispatcher_(dispatcher), id_(id) {}
+
+    void timeoutExpired() noexcept override {
+      dispatcher_->timeoutExpired(id_);
+    }
+
+   private:
+    MultiplexClientDispatcher* dispatcher_;
+    uint64_t id_;
+  };
+
+  struct PendingRequest {
+    folly::Promise<Resp> promise;
+    std::unique_ptr<RequestTimeout> timeout;
+  };
+
+  folly::EventBase* getEventBase() {
+    auto transport = this->pipeline_->getTransport();
+    return transport && transport->getEventBase()
+      ? transport->getEventBase()
+      : folly::EventBaseManager::get()->getEventBase();
+  }
+
+  void timeoutExpired(uint64_t id) {
+    auto it = pending_.find(id);
+    DCHECK(it != pending_.end());
+    auto pending = std::move(it->second);
+    pending_.erase(it);
+    pending.promise.setException(folly::FutureTimeout());
+  }
+
+  void failAll(const folly::exception_wrapper& e) {
+    auto pending = std::move(pending_);
+    pending_.clear();
+    for (auto& entry : pending) {
+      entry.second.promise.setException(e);
+    }
+  }
+
+  std::function<void(Req&, uint64_t)> setRequestId_;
+  std::function<uint64_t(const Resp&)> getRequestId_;
+  std::chrono::milliseconds timeout_;
+  uint64_t nextRequestId_{1};
+  folly::F14FastMap<uint64_t, PendingRequest> pending_;
+};
 
 } // namespace wangle
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * Thrown by ConcurrencyLimitFilter for requests over the limit.
+ */
+class ConcurrencyLimitExceeded : public std::runtime_error {
+ public:
+  ConcurrencyLimitExceeded()
+      : std::runtime_error("Concurrency limit exceeded") {}
+};
+
+struct ConcurrencyLimitOptions {
+  double initialLimit{20};
+  double minLimit{1};
+  double maxLimit{1000};
+
+  /**
+   * How far latency may rise above the no-load latency before the limit
+   * starts to shrink; 2 means up to twice the no-load latency is fine.
+   */
+  double rttTolerance{2};
+
+  /**
+   * Weight of each new estimate in the limit, between 0 and 1.
+   */
+  double smoothing{0.2};
+
+  /**
+   * The limit is multiplied by this when a request fails.
+   */
+  double backoffRatio{0.9};
+
+  /**
+   * The no-load latency is the lowest latency of the last minRttWindow to
+   * 2 * minRttWindow responses, so that it can rise when the backend gets
+   * slower for good but is never taken from a single, possibly queued,
+   * response.
+   */
+  uint32_t minRttWindow{1000};
+
+  /**
+   * Where latencies are measured from; steady_clock if unset.
+   */
+  std::function<std::chrono::steady_clock::time_point()> clock;
+};
+
+/**
+ * A service filter that limits the number of requests in flight to the
+ * service, adapting the limit to the latency it observes.
+ *
+ * The limit follows the gradient between the lowest latency seen recently
+ * (the latency without queueing) and the latency of each response: while
+ * they are within rttTolerance of each other the limit grows by about its
+ * square root, and as queueing pushes latency up it shrinks in proportion.
+ * Failed requests shrink it by backoffRatio.  The limit only grows while
+ * at least half of it is in use.
+ *
+ * Requests over the limit fail immediately with ConcurrencyLimitExceeded,
+ * and isAvailable() is false while the limit is reached, so that load
+ * balancers send requests elsewhere.  May be used from several threads.
+ */
+template <typename Req, typename Resp = Req>
+class ConcurrencyLimitFilter : public ServiceFilter<Req, Resp> {
+ public:
+  explicit ConcurrencyLimitFilter(
+      std::shared_ptr<Service<Req, Resp>> service,
+      ConcurrencyLimitOptions options = ConcurrencyLimitOptions())
+      : ServiceFilter<Req, Resp>(service)
+      , options_(options)
+      , limit_(options.initialLimit)
+      , intLimit_(uint32_t(options.initialLimit)) {
+    CHECK_GE(options_.minLimit, 1);
+    CHECK_LE(options_.minLimit, options_.initialLimit);
+    CHECK_LE(options_.initialLimit, options_.maxLimit);
+    CHECK_GT(options_.minRttWindow, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    auto inFlight = ++inFlight_;
+    if (inFlight > intLimit_.load(std::memory_order_relaxed)) {
+      --inFlight_;
+      rejected_++;
+      return folly::makeFuture<Resp>(
+        folly::make_exception_wrapper<ConcurrencyLimitExceeded>());
+    }
+
+    auto start = now();
+    return (*this->service_)(std::move(req))
+      .thenTry([this, start, inFlight](folly::Try<Resp> t) {
+        --inFlight_;
+        update(std::chrono::duration_cast<std::chrono::microseconds>(
+                 now() - start),
+               inFlight,
+               t.hasException());
+        return folly::makeFuture(std::move(t));
+      });
+  }
+
+  bool isAvailable() override {
+    return inFlight_.load(std::memory_order_relaxed) <
+      intLimit_.load(std::memory_order_relaxed) &&
+      this->service_->isAvailable();
+  }
+
+  uint32_t getLimit() const {
+    return intLimit_;
+  }
+
+  uint32_t getInFlight() const {
+    return inFlight_;
+  }
+
+  uint64_t getRejected() const {
+    return rejected_;
+  }
+
+  /**
+   * The current estimate of the no-load latency, zero before any response.
+   */
+  std::chrono::microseconds getMinRtt() {
+    std::lock_guard<std::mutex> g(mutex_);
+    return minRtt_;
+  }
+
+ private:
+  std::chrono::steady_clock::time_point now() const {
+    return options_.clock ? options_.clock()
+                          : std::chrono::steady_clock::now();
+  }
+
+  void update(std::chrono::microseconds rtt, uint32_t inFlight, bool failed) {
+    std::lock_guard<std::mutex> g(mutex_);
+    double limit;
+    if (failed) {
+      limit = limit_ * options_.backoffRatio;
+    } else {
+      // The minimum over two consecutive windows: the one being filled and
+      // the one before it, which ages out when the current one is full
+      windowMinRtt_ = std::min(windowMinRtt_, rtt);
+      minRtt_ = std::max(
+        std::min(previousWindowMinRtt_, windowMinRtt_),
+        std::chrono::microseconds(1));
+      if (++samples_ >= options_.minRttWindow) {
+        samples_ = 0;
+        previousWindowMinRtt_ = windowMinRtt_;
+        windowMinRtt_ = std::chrono::microseconds::max();
+      }
+      double gradient = std::max(
+        0.5,
+        std::min(1.0,
+                 options_.rttTolerance * minRtt_.count() /
+                   std::max<double>(rtt.count(), 1)));
+      limit = limit_ * gradient + std::sqrt(limit_);
+      if (inFlight * 2 < limit_) {
+        limit = std::min(limit, limit_);
+      }
+      limit = (1 - options_.smoothing) * limit_ + options_.smoothing * limit;
+    }
+    limit_ = std::max(options_.minLimit, std::min(options_.maxLimit, limit));
+    intLimit_ = uint32_t(limit_);
+  }
+
+  ConcurrencyLimitOptions options_;
+
+  std::mutex mutex_;
+  double limit_;
+  std::chrono::microseconds minRtt_{0};
+  std::chrono::microseconds windowMinRtt_{std::chrono::microseconds::max()};
+  std::chrono::microseconds previousWindowMinRtt_{
+    std::chrono::microseconds::max()};
+  uint32_t samples_{0};
+
+  std::atomic<uint32_t> intLimit_;
+  std::atomic<uint32_t> inFlight_{0};
+  std::atomic<uint64_t> rejected_{0};
+};
+
+} // namespace wangle
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include <folly/Random.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+struct ConnectionPoolOptions {
+  size_t connectionsPerEndpoint{2};
+  std::chrono::milliseconds connectTimeout{1000};
+
+  /**
+   * Broken or failed connections are retried after minReconnectDelay,
+   * doubling on each failure up to maxReconnectDelay.
+   */
+  std::chrono::milliseconds minReconnectDelay{100};
+  std::chrono::milliseconds maxReconnectDelay{10000};
+};
+
+struct ConnectionPoolStats {
+  // Requests sent on a connected connection straight away
+  uint64_t hits{0};
+  // Requests that had to wait for a connection to come up
+  uint64_t misses{0};
+  uint64_t completed{0};
+  uint64_t failed{0};
+  uint64_t connects{0};
+  uint64_t connectFailures{0};
+
+  // Of completed and failed requests, from dispatch to response
+  std::chrono::microseconds totalLatency{0};
+  std::chrono::microseconds maxLatency{0};
+
+  std::chrono::microseconds meanLatency() const {
+    auto requests = completed + failed;
+    return requests ? totalLatency / requests : std::chrono::microseconds(0);
+  }
+};
+
+/**
+ * A Service that spreads requests over a pool of warm connections to a set
+ * of endpoints.  Each connection is a ClientBootstrap running pipelines
+ * from pipelineFactory, with a Service made by serviceFactory (typically
+ * wrapping a client dispatcher that allows several requests in flight,
+ * such as PipelinedClientDispatcher or MultiplexClientDispatcher).
+ *
+ * Each request goes to the less loaded, by requests in flight, of two
+ * connections picked at random.  Connections that fail to connect or that
+ * break are reconnected in the background with exponential backoff.  When
+ * no connection is up, requests wait for the next one to connect, and fail
+ * if connecting fails while none is up.
+ *
+ * The pool and all its connections live on the EventBase of the thread
+ * that creates it, which is the only thread it may be used from.
+ */
+template <typename Pipeline, typename Req, typename Resp = Req>
+class ConnectionPoolService : public Service<Req, Resp> {
+ public:
+  ConnectionPoolService(
+      std::vector<folly::SocketAddress> endpoints,
+      std::shared_ptr<PipelineFactory<Pipeline>> pipelineFactory,
+      std::shared_ptr<ServiceFactory<Pipeline, Req, Resp>> serviceFactory,
+      ConnectionPoolOptions options = ConnectionPoolOptions())
+      : endpoints_(std::move(endpoints))
+      , pipelineFactory_(std::move(pipelineFactory))
+      , serviceFactory_(std::move(serviceFactory))
+      , options_(options)
+      , evb_(folly::EventBaseManager::get()->getEventBase()) {
+    CHECK(!endpoints_.empty());
+    CHECK_GT(options_.connectionsPerEndpoint, 0);
+    for (size_t i = 0; i < endpoints_.size(); i++) {
+      for (size_t j = 0; j < options_.connectionsPerEndpoint; j++) {
+        connections_.push_back(std::make_unique<Connection>(this, i));
+      }
+    }
+    for (auto& conn : connections_) {
+      connect(*conn);
+    }
+  }
+
+  ~ConnectionPoolService() override {
+    closed_ = true;
+    failWaiters(folly::make_exception_wrapper<std::runtime_error>(
+      "Connection pool destroyed"));
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    if (closed_) {
+      return folly::makeFuture<Resp>(
+        folly::make_exception_wrapper<std::runtime_error>("Pool closed"));
+    }
+    if (auto conn = pick()) {
+      stats_.hits++;
+      return send(*conn, std::move(req));
+    }
+    stats_.misses++;
+    waiters_.emplace_back(std::move(req), folly::Promise<Resp>());
+    return waiters_.back().second.getFuture();
+  }
+
+  folly::Future<folly::Unit> close() override {
+    if (closed_) {
+      return folly::makeFuture();
+    }
+    closed_ = true;
+    failWaiters(
+      folly::make_exception_wrapper<std::runtime_error>("Pool closed"));
+    for (auto& conn : connections_) {
+      conn->cancelTimeout();
+      if (conn->service) {
+        conn->service->close();
+      }
+    }
+    return folly::makeFuture();
+  }
+
+  bool isAvailable() override {
+    if (closed_) {
+      return false;
+    }
+    for (auto& conn : connections_) {
+      if (checkHealth(*conn)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const ConnectionPoolStats& getStats() const {
+    return stats_;
+  }
+
+  size_t getConnectedCount() {
+    size_t count = 0;
+    for (auto& conn : connections_) {
+      if (checkHealth(*conn)) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+ private:
+  struct Connection : public folly::HHWheelTimer::Callback {
+    Connection(ConnectionPoolService* p, size_t e) : pool(p), endpoint(e) {}
+
+    // Reconnect timer
+    void timeoutExpired() noexcept override {
+      pool->connect(*this);
+    }
+
+    ConnectionPoolService* pool;
+    size_t endpoint;
+    std::shared_ptr<ClientBootstrap<Pipeline>> client;
+    std::shared_ptr<Service<Req, Resp>> service;
+    size_t inFlight{0};
+    bool connecting{false};
+    std::chrono::milliseconds backoff{0};
+  };
+
+  void connect(Connection& conn) {
+    if (closed_) {
+      return;
+    }
+    conn.connecting = true;
+    conn.service.reset();
+    conn.inFlight = 0;
+    conn.client = std::make_shared<ClientBootstrap<Pipeline>>();
+    conn.client->pipelineFactory(pipelineFactory_);
+
+    auto client = conn.client;
+    std::weak_ptr<bool> alive = alive_;
+    client->connect(endpoints_[conn.endpoint], options_.connectTimeout)
+      .thenValue([serviceFactory = serviceFactory_, client](Pipeline*) {
+        return (*serviceFactory)(client);
+      })
+      .thenTry([this, alive, &conn, client](
+                   folly::Try<std::shared_ptr<Service<Req, Resp>>> t) {
+        if (!alive.lock() || conn.client != client) {
+          return;
+        }
+        conn.connecting = false;
+        if (t.hasException()) {
+          stats_.connectFailures++;
+          scheduleReconnect(conn);
+          if (!isAvailable() && !isConnecting()) {
+            failWaiters(t.exception());
+          }
+          return;
+        }
+        stats_.connects++;
+        conn.service = std::move(t.value());
+        conn.backoff = std::chrono::milliseconds(0);
+        serveWaiters();
+      });
+  }
+
+  void scheduleReconnect(Connection& conn) {
+    if (closed_ || conn.isScheduled()) {
+      return;
+    }
+    conn.backoff = conn.backoff.count() == 0
+      ? options_.minReconnectDelay
+      : std::min(conn.backoff * 2, options_.maxReconnectDelay);
+    evb_->timer().scheduleTimeout(&conn, conn.backoff);
+  }
+
+  // Whether conn can take requests; schedules a reconnect if it broke
+  bool checkHealth(Connection& conn) {
+    if (!conn.service) {
+      return false;
+    }
+    auto pipeline = conn.client->getPipeline();
+    auto transport = pipeline ? pipeline->getTransport() : nullptr;
+    if (!transport || !transport->good()) {
+      conn.service.reset();
+      scheduleReconnect(conn);
+      return false;
+    }
+    return conn.service->isAvailable();
+  }
+
+  bool isConnecting() const {
+    for (auto& conn : connections_) {
+      if (conn->connecting) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Power of two choices, falling back to a scan when both picks are down
+  Connection* pick() {
+    Connection* best = nullptr;
+    for (int i = 0; i < 2; i++) {
+      auto& conn = *connections_[folly::Random::rand32(connections_.size())];
+      if (checkHealth(conn) && (!best || conn.inFlight < best->inFlight)) {
+        best = &conn;
+      }
+    }
+    if (!best) {
+      for (auto& conn : connections_) {
+        if (checkHealth(*conn) && (!best || conn->inFlight < best->inFlight)) {
+          best = conn.get();
+        }
+      }
+    }
+    return best;
+  }
+
+  folly::Future<Resp> send(Connection& conn, Req req) {
+    conn.inFlight++;
+    auto start = std::chrono::steady_clock::now();
+    auto service = conn.service;
+    std::weak_ptr<bool> alive = alive_;
+    // A service that throws must still give back its inFlight count
+    return folly::makeFutureWith([&] { return (*service)(std::move(req)); })
+      .thenTry([this, alive, &conn, service, start](folly::Try<Resp> t) {
+        if (alive.lock()) {
+          if (conn.service == service) {
+            conn.inFlight--;
+          }
+          auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+          stats_.totalLatency += latency;
+          stats_.maxLatency = std::max(stats_.maxLatency, latency);
+          if (t.hasException()) {
+            stats_.failed++;
+            checkHealth(conn);
+          } else {
+            stats_.completed++;
+          }
+        }
+        return folly::makeFuture(std::move(t));
+      });
+  }
+
+  void serveWaiters() {
+    while (!waiters_.empty()) {
+      auto conn = pick();
+      if (!conn) {
+        return;
+      }
+      auto waiter = std::move(waiters_.front());
+      waiters_.pop_front();
+      send(*conn, std::move(waiter.first))
+        .thenTry([p = std::move(waiter.second)](folly::Try<Resp> t) mutable {
+          p.setTry(std::move(t));
+        });
+    }
+  }
+
+  void failWaiters(const folly::exception_wrapper& e) {
+    auto waiters = std::move(waiters_);
+    waiters_.clear();
+    for (auto& waiter : waiters) {
+      waiter.second.setException(e);
+    }
+  }
+
+  std::vector<folly::SocketAddress> endpoints_;
+  std::shared_ptr<PipelineFactory<Pipeline>> pipelineFactory_;
+  std::shared_ptr<ServiceFactory<Pipeline, Req, Resp>> serviceFactory_;
+  ConnectionPoolOptions options_;
+  folly::EventBase* evb_;
+
+  std::vector<std::unique_ptr<Connection>> connections_;
+  std::deque<std::pair<Req, folly::Promise<Resp>>> waiters_;
+  ConnectionPoolStats stats_;
+  bool closed_{false};
+
+  // Guards callbacks that complete after the pool is destroyed
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+} // namespace wangle
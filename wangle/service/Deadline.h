@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <folly/Optional.h>
+#include <folly/io/async/Request.h>
+
+namespace wangle {
+
+/**
+ * Thrown for requests dropped because their deadline passed.
+ */
+class DeadlineExceeded : public std::runtime_error {
+ public:
+  DeadlineExceeded() : std::runtime_error("Deadline exceeded") {}
+};
+
+/**
+ * The time by which the current request must be answered, carried in the
+ * folly::RequestContext so that it follows the request through futures,
+ * executors and filters without changing the Service interface.  Set by
+ * DeadlineFilter; ExecutorFilter drops queued requests past it, and
+ * TimeoutFilter and MultiplexClientDispatcher wait no longer than it.
+ */
+class Deadline : public folly::RequestData {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit Deadline(Clock::time_point deadline) : deadline_(deadline) {}
+
+  bool hasCallback() override {
+    return false;
+  }
+
+  /**
+   * The deadline of the current request, if it has one.
+   */
+  static folly::Optional<Clock::time_point> get() {
+    auto ctx = folly::RequestContext::try_get();
+    if (!ctx) {
+      return folly::none;
+    }
+    auto data = static_cast<Deadline*>(ctx->getContextData(token()));
+    if (!data) {
+      return folly::none;
+    }
+    return data->deadline_;
+  }
+
+  /**
+   * The time left before the current request's deadline, which is zero or
+   * less once it has passed.
+   */
+  static folly::Optional<std::chrono::milliseconds> remaining() {
+    auto deadline = get();
+    if (!deadline) {
+      return folly::none;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+      *deadline - Clock::now());
+  }
+
+  static bool expired() {
+    auto deadline = get();
+    return deadline && *deadline <= Clock::now();
+  }
+
+  /**
+   * The lesser of timeout and the time left before the current request's
+   * deadline.  A zero timeout means none.
+   */
+  static std::chrono::milliseconds bound(std::chrono::milliseconds timeout) {
+    auto left = remaining();
+    if (!left) {
+      return timeout;
+    }
+    auto bounded = std::max(*left, std::chrono::milliseconds(1));
+    return timeout.count() > 0 ? std::min(timeout, bounded) : bounded;
+  }
+
+  static const folly::RequestToken& token() {
+    static folly::RequestToken token("wangle::Deadline");
+    return token;
+  }
+
+ private:
+  Clock::time_point deadline_;
+};
+
+} // namespace wangle
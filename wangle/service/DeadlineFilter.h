@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+
+#include <wangle/service/Deadline.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * A service filter that gives requests a deadline, carried to the filters
+ * and dispatchers below it in the request's folly::RequestContext (see
+ * Deadline).  The deadline is the earliest of:
+ *  - any deadline the request already has, from a filter further up,
+ *  - timeout from now, if timeout is non-zero,
+ *  - the time budget getBudget reads from the request, if any, such as one
+ *    sent by the client.
+ *
+ * Requests already past their deadline fail with DeadlineExceeded without
+ * reaching the service.  Otherwise setBudget, if given, stamps the time
+ * left onto the request, so that a client can forward it to the server.
+ */
+template <typename Req, typename Resp = Req>
+class DeadlineFilter : public ServiceFilter<Req, Resp> {
+ public:
+  explicit DeadlineFilter(
+      std::shared_ptr<Service<Req, Resp>> service,
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+      std::function<folly::Optional<std::chrono::milliseconds>(const Req&)>
+          getBudget = nullptr,
+      std::function<void(Req&, std::chrono::milliseconds)> setBudget = nullptr)
+      : ServiceFilter<Req, Resp>(service)
+      , timeout_(timeout)
+      , getBudget_(std::move(getBudget))
+      , setBudget_(std::move(setBudget)) {}
+
+  folly::Future<Resp> operator()(Req req) override {
+    auto now = Deadline::Clock::now();
+    auto deadline = Deadline::get();
+    auto limit = [&](std::chrono::milliseconds budget) {
+      if (!deadline || now + budget < *deadline) {
+        deadline = now + budget;
+      }
+    };
+    if (timeout_.count() > 0) {
+      limit(timeout_);
+    }
+    if (getBudget_) {
+      if (auto budget = getBudget_(req)) {
+        limit(*budget);
+      }
+    }
+    if (!deadline) {
+      return (*this->service_)(std::move(req));
+    }
+
+    if (*deadline <= now) {
+      return folly::makeFuture<Resp>(
+        folly::make_exception_wrapper<DeadlineExceeded>());
+    }
+    if (setBudget_) {
+      setBudget_(req,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                   *deadline - now));
+    }
+    folly::ShallowCopyRequestContextScopeGuard guard(
+      Deadline::token(), std::make_unique<Deadline>(*deadline));
+    return (*this->service_)(std::move(req));
+  }
+
+ private:
+  std::chrono::milliseconds timeout_;
+  std::function<folly::Optional<std::chrono::milliseconds>(const Req&)>
+    getBudget_;
+  std::function<void(Req&, std::chrono::milliseconds)> setBudget_;
+};
+
+} // namespace wangle
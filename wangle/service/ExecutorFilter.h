@@ -16,31 +16,205 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include <folly/ThreadLocal.h>
+#include <folly/container/F14Map.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <wangle/service/Deadline.h>
 #include <wangle/service/Service.h>
 
 namespace wangle {
 
+namespace detail {
+
+// The executor running the current ExecutorFilter task on this thread
+inline folly::Executor*& currentFilterExecutor() {
+  static thread_local folly::Executor* executor = nullptr;
+  return executor;
+}
+
+} // namespace detail
+
 /**
  * A service that runs all requests through an executor.
+ *
+ * Requests made while already running on the executor, either from a task
+ * of an ExecutorFilter or from the loop of an EventBase executor, call the
+ * service directly instead of queueing another task.
+ *
+ * With batchSameLoop, requests made from a running EventBase are collected
+ * until the end of its loop iteration and submitted as tasks of up to
+ * maxBatchSize requests, saving a queue operation per request when a burst
+ * of requests is read at once.  This is off by default: requests in a
+ * batch run one after another on one thread, so a slow request delays the
+ * rest of its batch and a pool of executor threads sees less parallelism.
+ *
+ * With several executors, such as one per core, requests are spread round
+ * robin, or by an affinity key so that related requests always run on the
+ * same executor.  A priority function passes each request's priority to
+ * Executor::addWithPriority(), which the executors must then support.
+ *
+ * Tasks run in the folly::RequestContext of their request, and requests
+ * whose Deadline passes while queued fail with DeadlineExceeded instead of
+ * running.
+ *
+ * The filter must outlive the EventBases it is called from.
  */
 template <typename Req, typename Resp = Req>
 class ExecutorFilter : public ServiceFilter<Req, Resp> {
  public:
- explicit ExecutorFilter(
-   std::shared_ptr<folly::Executor> exe,
-   std::shared_ptr<Service<Req, Resp>> service)
+  explicit ExecutorFilter(
+    std::shared_ptr<folly::Executor> exe,
+    std::shared_ptr<Service<Req, Resp>> service)
+      : ExecutorFilter(
+          std::vector<std::shared_ptr<folly::Executor>>{std::move(exe)},
+          std::move(service)) {}
+
+  ExecutorFilter(
+    std::vector<std::shared_ptr<folly::Executor>> exes,
+    std::shared_ptr<Service<Req, Resp>> service,
+    std::function<uint64_t(const Req&)> affinity = nullptr,
+    std::function<int8_t(const Req&)> priority = nullptr,
+    bool batchSameLoop = false,
+    size_t maxBatchSize = 16)
       : ServiceFilter<Req, Resp>(service)
-      , exe_(exe) {}
+      , exes_(std::move(exes))
+      , affinity_(std::move(affinity))
+      , priority_(std::move(priority))
+      , batchSameLoop_(batchSameLoop)
+      , maxBatchSize_(maxBatchSize) {
+    CHECK(!exes_.empty());
+    CHECK_GT(maxBatchSize_, 0);
+    for (auto& exe : exes_) {
+      CHECK(exe);
+    }
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    size_t index = 0;
+    if (affinity_) {
+      index = affinity_(req) % exes_.size();
+    } else if (exes_.size() > 1) {
+      index = next_++ % exes_.size();
+    }
+    auto exe = exes_[index].get();
+    if (isCurrent(exe)) {
+      return folly::makeFutureWith(
+        [&] { return (*this->service_)(std::move(req)); });
+    }
+
+    auto priority = priority_ ? priority_(req) : folly::Executor::MID_PRI;
+    folly::Promise<Resp> promise;
+    auto f = promise.getFuture();
+    folly::Func task = [this,
+                        exe,
+                        req = std::move(req),
+                        promise = std::move(promise),
+                        ctx = folly::RequestContext::saveContext()]() mutable {
+      folly::RequestContextScopeGuard guard(std::move(ctx));
+      if (Deadline::expired()) {
+        promise.setException(DeadlineExceeded());
+        return;
+      }
+      auto previous = detail::currentFilterExecutor();
+      detail::currentFilterExecutor() = exe;
+      folly::makeFutureWith(
+        [&] { return (*this->service_)(std::move(req)); })
+        .thenTry(
+          [promise = std::move(promise)](folly::Try<Resp> t) mutable {
+            promise.setTry(std::move(t));
+          });
+      detail::currentFilterExecutor() = previous;
+    };
 
- folly::Future<Resp> operator()(Req req) override {
-   return via(exe_.get()).thenValue(
-     [req = std::move(req), this](auto&&) mutable {
-       return (*this->service_)(std::move(req));
-     });
+    auto evb = batchSameLoop_
+      ? folly::EventBaseManager::get()->getExistingEventBase()
+      : nullptr;
+    if (evb && evb->inRunningEventBaseThread()) {
+      batch_->add(this, evb, index, priority, std::move(task));
+    } else {
+      submit(index, priority, std::move(task));
+    }
+    return f;
   }
 
  private:
-  std::shared_ptr<folly::Executor> exe_;
+  // Requests made during the current loop iteration of this thread's
+  // EventBase, by executor and priority
+  class Batch : public folly::EventBase::LoopCallback {
+   public:
+    void add(ExecutorFilter* filter,
+             folly::EventBase* evb,
+             size_t index,
+             int8_t priority,
+             folly::Func task) {
+      if (!isLoopCallbackScheduled()) {
+        filter_ = filter;
+        evb->runInLoop(this);
+      }
+      tasks_[(uint64_t(index) << 8) | uint8_t(priority)].push_back(
+        std::move(task));
+    }
+
+    void runLoopCallback() noexcept override {
+      auto tasks = std::move(tasks_);
+      tasks_.clear();
+      for (auto& it : tasks) {
+        auto index = it.first >> 8;
+        auto priority = int8_t(it.first & 0xff);
+        auto& pending = it.second;
+        for (size_t i = 0; i < pending.size(); i += filter_->maxBatchSize_) {
+          auto end = std::min(pending.size(), i + filter_->maxBatchSize_);
+          if (end - i == 1) {
+            filter_->submit(index, priority, std::move(pending[i]));
+            continue;
+          }
+          std::vector<folly::Func> batch(
+            std::make_move_iterator(pending.begin() + i),
+            std::make_move_iterator(pending.begin() + end));
+          filter_->submit(
+            index, priority, [batch = std::move(batch)]() mutable {
+              for (auto& task : batch) {
+                task();
+              }
+            });
+        }
+      }
+    }
+
+   private:
+    ExecutorFilter* filter_{nullptr};
+    folly::F14FastMap<uint64_t, std::vector<folly::Func>> tasks_;
+  };
+
+  bool isCurrent(folly::Executor* exe) const {
+    if (detail::currentFilterExecutor() == exe) {
+      return true;
+    }
+    auto evb = dynamic_cast<folly::EventBase*>(exe);
+    return evb && evb->inRunningEventBaseThread();
+  }
+
+  void submit(size_t index, int8_t priority, folly::Func task) {
+    if (priority_) {
+      exes_[index]->addWithPriority(std::move(task), priority);
+    } else {
+      exes_[index]->add(std::move(task));
+    }
+  }
+
+  std::vector<std::shared_ptr<folly::Executor>> exes_;
+  std::function<uint64_t(const Req&)> affinity_;
+  std::function<int8_t(const Req&)> priority_;
+  bool batchSameLoop_;
+  size_t maxBatchSize_;
+  std::atomic<size_t> next_{0};
+  folly::ThreadLocal<Batch> batch_;
 };
 
 } // namespace wangle
@@ -13,8 +13,11 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+
 #pragma once
 
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/HHWheelTimer.h>
 #include <wangle/service/Service.h>
 
 namespace wangle {
@@ -22,6 +25,14 @@ namespace wangle {
  * A service filter that expires the self service after a certain
  * amount of idle time, or after a maximum amount of time total.
  * Idle timeout is cancelled when any requests are outstanding.
+ *
+ * Both timeouts run on the HHWheelTimer of evb (by default the EventBase
+ * of the creating thread), which requests must be made from. That
+ * EventBase has to be looping for the timeouts to fire; a thread that
+ * never loops its own EventBase (e.g. main() of a client) must pass the
+ * EventBase it uses for I/O instead. Note the DCHECK below cannot catch
+ * this, since isInEventBaseThread() is true for an EventBase that has
+ * not started looping.
  */
 
 template <typename Req, typename Resp = Req>
@@ -32,55 +43,66 @@ class ExpiringFilter : public ServiceFilter<Req, Resp> {
                  = std::chrono::milliseconds(0),
                   std::chrono::milliseconds maxTime
                  = std::chrono::milliseconds(0),
-                 folly::Timekeeper* timekeeper = nullptr)
+                 folly::EventBase* evb = nullptr)
   : ServiceFilter<Req, Resp>(service)
   , idleTimeoutTime_(idleTimeoutTime)
   , maxTime_(maxTime)
-  , timekeeper_(timekeeper) {
+  , evb_(evb ? evb : folly::EventBaseManager::get()->getEventBase())
+  , idleTimeout_(this)
+  , maxTimeout_(this) {
 
     if (maxTime_ > std::chrono::milliseconds(0)) {
-      maxTimeout_ = folly::futures::sleepUnsafe(maxTime_, timekeeper_);
-      std::move(maxTimeout_).thenValue([this](auto&&) { this->close(); });
+      evb_->timer().scheduleTimeout(&maxTimeout_, maxTime_);
     }
     startIdleTimer();
   }
 
-  ~ExpiringFilter() override {
-    if (!idleTimeout_.isReady()) {
-      idleTimeout_.cancel();
-    }
-    if (!maxTimeout_.isReady()) {
-      maxTimeout_.cancel();
-    }
-  }
-
   void startIdleTimer() {
     if (requests_ != 0) {
       return;
     }
     if (idleTimeoutTime_ > std::chrono::milliseconds(0)) {
-      idleTimeout_ = folly::futures::sleepUnsafe(idleTimeoutTime_, timekeeper_);
-      std::move(idleTimeout_).thenValue([this](auto&&) { this->close(); });
+      evb_->timer().scheduleTimeout(&idleTimeout_, idleTimeoutTime_);
     }
   }
 
   folly::Future<Resp> operator()(Req req) override {
-    if (!idleTimeout_.isReady()) {
-      idleTimeout_.cancel();
-    }
+    DCHECK(evb_->isInEventBaseThread());
+    idleTimeout_.cancelTimeout();
     requests_++;
     return (*this->service_)(std::move(req)).ensure([this](){
-        requests_--;
-        startIdleTimer();
+      if (evb_->isInEventBaseThread()) {
+        requestDone();
+      } else {
+        evb_->runInEventBaseThread([this]() { requestDone(); });
+      }
     });
   }
 
  private:
-  folly::Future<folly::Unit> idleTimeout_;
-  folly::Future<folly::Unit> maxTimeout_;
+  // Closes the service when it expires
+  class ExpireTimeout : public folly::HHWheelTimer::Callback {
+   public:
+    explicit ExpireTimeout(ExpiringFilter* filter) : filter_(filter) {}
+
+    void timeoutExpired() noexcept override {
+      filter_->close();
+    }
+
+   private:
+    ExpiringFilter* filter_;
+  };
+
+  void requestDone() {
+    requests_--;
+    startIdleTimer();
+  }
+
   std::chrono::milliseconds idleTimeoutTime_{0};
   std::chrono::milliseconds maxTime_{0};
-  folly::Timekeeper* timekeeper_;
+  folly::EventBase* evb_;
+  ExpireTimeout idleTimeout_;
+  ExpireTimeout maxTimeout_;
   uint32_t requests_{0};
 };
 
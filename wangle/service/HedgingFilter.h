@@ -0,0 +1,268 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+struct HedgingOptions {
+  /**
+   * A hedge is sent once a request has taken longer than this percentile
+   * of recent response latencies.
+   */
+  double percentile{95};
+
+  /**
+   * The hedge delay used until minSamples responses have been seen.
+   */
+  std::chrono::milliseconds initialDelay{10};
+  std::chrono::milliseconds minDelay{1};
+  std::chrono::milliseconds maxDelay{1000};
+
+  /**
+   * Latencies are taken from the last windowSize responses.
+   */
+  size_t windowSize{1024};
+  size_t minSamples{100};
+
+  /**
+   * Hedges and retries each spend a token from a bucket that every request
+   * refills by budgetRatio tokens, so together they stay below about that
+   * fraction of requests.  The bucket holds at most maxTokens, and starts
+   * full.
+   */
+  double budgetRatio{0.1};
+  double maxTokens{10};
+};
+
+struct HedgingStats {
+  uint64_t requests{0};
+  // Second requests sent because the first was slow
+  uint64_t hedges{0};
+  // Hedges that responded before the request they hedged
+  uint64_t hedgeWins{0};
+  // Second requests sent because the first failed
+  uint64_t retries{0};
+  // Hedges and retries not sent for lack of budget
+  uint64_t budgetExhausted{0};
+
+  double hedgeRate() const {
+    return requests ? double(hedges) / requests : 0;
+  }
+};
+
+/**
+ * A service filter that cuts tail latency by hedging: if the service has
+ * not responded to a request after a delay tracking a high percentile of
+ * its latency, the request is sent again, and whichever response arrives
+ * first is returned.  The other request is cancelled by raising
+ * folly::FutureCancellation on its future.  A request that fails before
+ * its hedge is sent is retried instead.  Hedges and retries share a token
+ * bucket budget, so that a slow or failing backend does not get twice the
+ * load.
+ *
+ * The service must be safe to call twice with the same request, so Req
+ * must be copyable.  Requests must be made from evb's thread (by default
+ * the EventBase of the creating thread); responses that complete on
+ * another thread are handed back to it.
+ */
+template <typename Req, typename Resp = Req>
+class HedgingFilter : public ServiceFilter<Req, Resp> {
+ public:
+  explicit HedgingFilter(std::shared_ptr<Service<Req, Resp>> service,
+                         HedgingOptions options = HedgingOptions(),
+                         folly::EventBase* evb = nullptr)
+      : ServiceFilter<Req, Resp>(service)
+      , state_(std::make_shared<State>(
+          service,
+          options,
+          evb ? evb : folly::EventBaseManager::get()->getEventBase())) {
+    CHECK_GT(options.percentile, 0);
+    CHECK_LE(options.percentile, 100);
+    CHECK_GT(options.windowSize, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    DCHECK(state_->evb->isInEventBaseThread());
+    state_->stats.requests++;
+    state_->tokens = std::min(state_->options.maxTokens,
+                              state_->tokens + state_->options.budgetRatio);
+
+    auto request = std::make_shared<Request>(state_, std::move(req));
+    auto f = request->promise.getFuture();
+    request->send();
+    if (!request->promise.isFulfilled()) {
+      state_->evb->timer().scheduleTimeout(request.get(), state_->delay());
+    }
+    return f;
+  }
+
+  const HedgingStats& getStats() const {
+    return state_->stats;
+  }
+
+  /**
+   * The delay after which requests are hedged.
+   */
+  std::chrono::milliseconds getHedgeDelay() const {
+    return state_->delay();
+  }
+
+ private:
+  // Shared with outstanding requests, which may outlive the filter
+  struct State {
+    State(std::shared_ptr<Service<Req, Resp>> svc,
+          HedgingOptions opts,
+          folly::EventBase* base)
+        : service(std::move(svc))
+        , options(opts)
+        , evb(base)
+        , tokens(opts.maxTokens) {}
+
+    bool takeToken() {
+      if (tokens < 1) {
+        stats.budgetExhausted++;
+        return false;
+      }
+      tokens -= 1;
+      return true;
+    }
+
+    void addSample(std::chrono::microseconds latency) {
+      if (latencies.size() < options.windowSize) {
+        latencies.push_back(latency.count());
+      } else {
+        latencies[samples % options.windowSize] = latency.count();
+      }
+      // Sorting the window for every request would cost more than hedging
+      // saves, so the percentile is recomputed every so often
+      if (++samples >= options.minSamples &&
+          samples % std::max<size_t>(1, options.windowSize / 16) == 0) {
+        auto sorted = latencies;
+        auto nth = sorted.begin() +
+          size_t((sorted.size() - 1) * options.percentile / 100);
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        percentileDelay = std::chrono::ceil<std::chrono::milliseconds>(
+          std::chrono::microseconds(*nth));
+      }
+    }
+
+    std::chrono::milliseconds delay() const {
+      if (samples < options.minSamples) {
+        return options.initialDelay;
+      }
+      return std::max(options.minDelay,
+                      std::min(options.maxDelay, percentileDelay));
+    }
+
+    std::shared_ptr<Service<Req, Resp>> service;
+    HedgingOptions options;
+    folly::EventBase* evb;
+    double tokens;
+    HedgingStats stats;
+    std::vector<int64_t> latencies;
+    size_t samples{0};
+    std::chrono::milliseconds percentileDelay{0};
+  };
+
+  // A request and its hedge.  The timer callback sends the hedge, and is
+  // cancelled once the request completes.
+  class Request : public folly::HHWheelTimer::Callback,
+                  public std::enable_shared_from_this<Request> {
+   public:
+    Request(std::shared_ptr<State> state, Req req)
+        : state_(std::move(state))
+        , req_(std::move(req))
+        , start_(std::chrono::steady_clock::now()) {}
+
+    void timeoutExpired() noexcept override {
+      if (!promise.isFulfilled() && sent_ == 1 && state_->takeToken()) {
+        state_->stats.hedges++;
+        send();
+      }
+    }
+
+    void send() {
+      auto i = sent_++;
+      auto evb = state_->evb;
+      calls_[i] = (*state_->service)(req_).thenTry(
+        [self = this->shared_from_this(), evb, i](folly::Try<Resp> t) mutable {
+          if (evb->isInEventBaseThread()) {
+            self->complete(i, std::move(t));
+          } else {
+            evb->runInEventBaseThread(
+              [self = std::move(self), i, t = std::move(t)]() mutable {
+                self->complete(i, std::move(t));
+              });
+          }
+        });
+    }
+
+    folly::Promise<Resp> promise;
+
+   private:
+    void complete(size_t i, folly::Try<Resp> t) {
+      if (promise.isFulfilled()) {
+        return;
+      }
+      if (t.hasException()) {
+        if (++failed_ < sent_) {
+          // The other request may still succeed
+          return;
+        }
+        if (sent_ == 1 && state_->takeToken()) {
+          state_->stats.retries++;
+          send();
+          return;
+        }
+        cancelTimeout();
+        promise.setTry(std::move(t));
+        return;
+      }
+
+      cancelTimeout();
+      if (i == 1 && failed_ == 0) {
+        state_->stats.hedgeWins++;
+      }
+      state_->addSample(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_));
+      promise.setTry(std::move(t));
+      if (sent_ == 2 && calls_[1 - i]) {
+        calls_[1 - i]->cancel();
+      }
+    }
+
+    std::shared_ptr<State> state_;
+    Req req_;
+    std::chrono::steady_clock::time_point start_;
+    folly::Optional<folly::Future<folly::Unit>> calls_[2];
+    size_t sent_{0};
+    size_t failed_{0};
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+} // namespace wangle
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <folly/Optional.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * Thrown by QueueingFilter for requests it sheds.
+ */
+class QueueOverloaded : public std::runtime_error {
+ public:
+  QueueOverloaded() : std::runtime_error("Queue overloaded") {}
+};
+
+struct QueueingOptions {
+  /**
+   * Requests past this many in flight to the service are queued.
+   */
+  size_t maxInFlight{64};
+
+  /**
+   * Requests past this many queued are rejected outright.
+   */
+  size_t maxQueueSize{1024};
+
+  /**
+   * Priorities run from 0, the highest, to numPriorities - 1.
+   */
+  size_t numPriorities{1};
+
+  /**
+   * The queueing delay that is acceptable to sustain.  The queue counts as
+   * overloaded for an interval after one in which no request waited less
+   * than target.
+   */
+  std::chrono::milliseconds target{5};
+  std::chrono::milliseconds interval{100};
+
+  /**
+   * Where queueing delays are measured from; steady_clock if unset.
+   */
+  std::function<std::chrono::steady_clock::time_point()> clock;
+};
+
+/**
+ * A server side service filter that bounds the requests in flight to the
+ * service, queueing the rest by priority, and sheds load from the queue
+ * with CoDel so that overload turns into fast rejections rather than ever
+ * growing latency.
+ *
+ * Requests are dequeued highest priority first.  While the queue is
+ * overloaded, requests that have waited more than twice target fail with
+ * QueueOverloaded, and the newest request is served first (adaptive
+ * LIFO), as it is the one most likely to still have a client waiting for
+ * it.  Otherwise the queue is first in, first out.
+ *
+ * isAvailable() is false while the queue is full.  With a
+ * MultiplexServerDispatcher given an error response, rejected requests are
+ * answered immediately.  May be used from several threads.
+ */
+template <typename Req, typename Resp = Req>
+class QueueingFilter : public ServiceFilter<Req, Resp> {
+ public:
+  explicit QueueingFilter(
+      std::shared_ptr<Service<Req, Resp>> service,
+      QueueingOptions options = QueueingOptions(),
+      std::function<size_t(const Req&)> getPriority = nullptr)
+      : ServiceFilter<Req, Resp>(service)
+      , getPriority_(std::move(getPriority))
+      , state_(std::make_shared<State>(service, options)) {
+    CHECK_GT(options.maxInFlight, 0);
+    CHECK_GT(options.numPriorities, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    auto& options = state_->options;
+    auto priority = getPriority_
+      ? std::min(getPriority_(req), options.numPriorities - 1)
+      : 0;
+    auto now = state_->now();
+    std::unique_lock<std::mutex> g(state_->mutex);
+    if (state_->inFlight < options.maxInFlight && state_->queued == 0) {
+      state_->inFlight++;
+      state_->overloaded(now, std::chrono::nanoseconds(0));
+      g.unlock();
+      return State::start(state_, std::move(req));
+    }
+    if (state_->queued >= options.maxQueueSize) {
+      g.unlock();
+      state_->rejected++;
+      return folly::makeFuture<Resp>(
+        folly::make_exception_wrapper<QueueOverloaded>());
+    }
+
+    auto& queue = state_->queues[priority];
+    queue.push_back(QueuedRequest{std::move(req), {}, now});
+    state_->queued++;
+    return queue.back().promise.getFuture();
+  }
+
+  bool isAvailable() override {
+    std::lock_guard<std::mutex> g(state_->mutex);
+    return state_->queued < state_->options.maxQueueSize &&
+      this->service_->isAvailable();
+  }
+
+  size_t getInFlight() const {
+    std::lock_guard<std::mutex> g(state_->mutex);
+    return state_->inFlight;
+  }
+
+  size_t getQueued() const {
+    std::lock_guard<std::mutex> g(state_->mutex);
+    return state_->queued;
+  }
+
+  uint64_t getRejected() const {
+    return state_->rejected;
+  }
+
+  bool isOverloaded() const {
+    std::lock_guard<std::mutex> g(state_->mutex);
+    return state_->isOverloaded;
+  }
+
+ private:
+  struct QueuedRequest {
+    Req req;
+    folly::Promise<Resp> promise;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  // Shared with outstanding requests, which may outlive the filter
+  struct State {
+    State(std::shared_ptr<Service<Req, Resp>> svc, QueueingOptions opts)
+        : service(std::move(svc))
+        , options(std::move(opts))
+        , queues(options.numPriorities)
+        , intervalStart(now()) {}
+
+    std::chrono::steady_clock::time_point now() const {
+      return options.clock ? options.clock()
+                           : std::chrono::steady_clock::now();
+    }
+
+    // Sends a request that holds an in flight slot
+    static folly::Future<Resp> start(std::shared_ptr<State> self, Req req) {
+      auto f = folly::makeFutureWith(
+        [&] { return (*self->service)(std::move(req)); });
+      if (f.isReady()) {
+        self->finished(self);
+        return f;
+      }
+      return std::move(f).thenTry([self](folly::Try<Resp> t) {
+        self->finished(self);
+        return folly::makeFuture(std::move(t));
+      });
+    }
+
+    // Hands the slot of a finished request to queued requests.  Requests
+    // the service answers at once free the slot again, so they are run in
+    // a loop rather than from their continuations, which would recurse as
+    // deep as the queue.
+    void finished(const std::shared_ptr<State>& self) {
+      while (auto request = next()) {
+        auto f = folly::makeFutureWith(
+          [&] { return (*service)(std::move(request->req)); });
+        if (f.isReady()) {
+          request->promise.setTry(std::move(f.getTry()));
+          continue;
+        }
+        std::move(f).thenTry(
+          [self, promise = std::move(request->promise)](
+              folly::Try<Resp> t) mutable {
+            promise.setTry(std::move(t));
+            self->finished(self);
+          });
+        return;
+      }
+    }
+
+    // Takes the next request to run, shedding stale ones, or gives up the
+    // slot if there is none
+    folly::Optional<QueuedRequest> next() {
+      std::vector<folly::Promise<Resp>> shed;
+      folly::Optional<QueuedRequest> request;
+      {
+        std::lock_guard<std::mutex> g(mutex);
+        auto time = now();
+        for (auto& queue : queues) {
+          while (!queue.empty() &&
+                 overloaded(time, time - queue.front().enqueued)) {
+            shed.push_back(std::move(queue.front().promise));
+            queue.pop_front();
+            queued--;
+          }
+          if (queue.empty()) {
+            continue;
+          }
+          if (isOverloaded) {
+            request = std::move(queue.back());
+            queue.pop_back();
+          } else {
+            request = std::move(queue.front());
+            queue.pop_front();
+          }
+          queued--;
+          break;
+        }
+        if (!request) {
+          inFlight--;
+        }
+      }
+
+      rejected += shed.size();
+      for (auto& promise : shed) {
+        promise.setException(QueueOverloaded());
+      }
+      return request;
+    }
+
+    // Feeds a queueing delay to CoDel, returning whether the request that
+    // waited it should be shed.  Must be called under mutex.
+    bool overloaded(std::chrono::steady_clock::time_point time,
+                    std::chrono::nanoseconds delay) {
+      if (time - intervalStart > options.interval) {
+        isOverloaded = minDelay > options.target;
+        minDelay = delay;
+        intervalStart = time;
+      } else {
+        minDelay = std::min(minDelay, delay);
+      }
+      return isOverloaded && delay > 2 * options.target;
+    }
+
+    std::shared_ptr<Service<Req, Resp>> service;
+    QueueingOptions options;
+
+    std::mutex mutex;
+    std::vector<std::deque<QueuedRequest>> queues;
+    size_t queued{0};
+    size_t inFlight{0};
+
+    bool isOverloaded{false};
+    std::chrono::nanoseconds minDelay{0};
+    std::chrono::steady_clock::time_point intervalStart;
+
+    std::atomic<uint64_t> rejected{0};
+  };
+
+  std::function<size_t(const Req&)> getPriority_;
+  std::shared_ptr<State> state_;
+};
+
+} // namespace wangle
@@ -16,14 +16,31 @@
 
 #pragma once
 
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <folly/io/async/EventBaseManager.h>
 #include <wangle/channel/Handler.h>
+#include <wangle/channel/ReadPauser.h>
 #include <wangle/service/Service.h>
 
 namespace wangle {
 
 /**
- * Dispatch requests from pipeline one at a time synchronously.
- * Concurrent requests are queued in the pipeline.
+ * Dispatch requests from pipeline one at a time: the next request is
+ * passed to the service only once the response to the previous one has
+ * been written.  Requests that arrive in the meantime are queued, and
+ * reads are paused while more than maxQueueSize requests are waiting.
+ *
+ * The event loop is never blocked on the service.  Responses that are
+ * ready immediately are written inline; others are written from the
+ * pipeline's EventBase when they complete.
+ *
+ * A failed request, including one whose service throws, is surfaced as a
+ * read exception fired to the next handler, and no response is written
+ * for it.  Protocols that cannot skip a response should set
+ * closeOnFailure, which closes the connection instead.
  */
 template <typename Req, typename Resp = Req>
 class SerialServerDispatcher : public HandlerAdapter<Req, Resp> {
@@ -31,22 +48,106 @@ class SerialServerDispatcher : public HandlerAdapter<Req, Resp> {
 
   typedef typename HandlerAdapter<Req, Resp>::Context Context;
 
-  explicit SerialServerDispatcher(Service<Req, Resp>* service)
-      : service_(service) {}
+  explicit SerialServerDispatcher(Service<Req, Resp>* service,
+                                  size_t maxQueueSize = 64,
+                                  bool closeOnFailure = false)
+      : service_(service)
+      , maxQueueSize_(maxQueueSize)
+      , closeOnFailure_(closeOnFailure) {}
 
   void read(Context* ctx, Req in) override {
-    auto resp = (*service_)(std::move(in)).get();
-    ctx->fireWrite(std::move(resp));
+    if (closed_) {
+      return;
+    }
+    queue_.push_back(std::move(in));
+    if (queue_.size() > maxQueueSize_) {
+      pauser_.pause(ctx);
+    }
+    if (!busy_) {
+      dispatchNext(ctx);
+    }
+  }
+
+  void transportInactive(Context* ctx) override {
+    pauser_.cancel();
+    ctx->fireTransportInactive();
   }
 
  private:
+  void dispatchNext(Context* ctx) {
+    busy_ = true;
+    while (!queue_.empty()) {
+      auto f = folly::makeFutureWith(
+        [&] { return (*service_)(std::move(queue_.front())); });
+      queue_.pop_front();
+      if (pauser_.isPaused() && queue_.size() <= maxQueueSize_ / 2) {
+        pauser_.resume();
+      }
+      if (!f.isReady()) {
+        auto transport = ctx->getTransport();
+        auto evb = transport && transport->getEventBase()
+          ? transport->getEventBase()
+          : folly::EventBaseManager::get()->getEventBase();
+        std::weak_ptr<bool> alive = alive_;
+        std::move(f).via(evb).thenTry(
+          [this, alive, ctx](folly::Try<Resp> t) {
+            if (alive.lock() && respond(ctx, std::move(t))) {
+              dispatchNext(ctx);
+            }
+          });
+        return;
+      }
+      if (!respond(ctx, std::move(f.getTry()))) {
+        return;
+      }
+    }
+    busy_ = false;
+  }
+
+  // Returns false if the connection was closed, in which case closing may
+  // already have destroyed this handler
+  bool respond(Context* ctx, folly::Try<Resp> t) {
+    if (t.hasValue()) {
+      ctx->fireWrite(std::move(t.value()));
+      return true;
+    }
+    if (!closeOnFailure_) {
+      ctx->fireReadException(std::move(t.exception()));
+      return true;
+    }
+    closed_ = true;
+    queue_.clear();
+    ctx->fireClose();
+    return false;
+  }
 
   Service<Req, Resp>* service_;
+  size_t maxQueueSize_;
+  bool closeOnFailure_;
+  std::deque<Req> queue_;
+  bool busy_{false};
+  bool closed_{false};
+  ReadPauser pauser_;
+
+  // Guards callbacks that complete after the handler is destroyed
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
 };
 
 /**
  * Dispatch requests from pipeline as they come in.
  * Responses are queued until they can be sent in order.
+ *
+ * At most maxInFlight requests are passed to the service at a time, their
+ * responses kept in a ring indexed by sequence number until all earlier
+ * ones have been written.  Requests beyond that wait in a queue, and reads
+ * are paused while maxInFlight or more requests are in flight or queued,
+ * so a slow request cannot make responses pile up without bound.
+ *
+ * Responses are moved, never copied.  A failed request, including one
+ * whose service throws, is surfaced as a read exception fired to the next
+ * handler when its turn to be written comes, and no response is written
+ * for it.  Protocols that cannot skip a response should set
+ * closeOnFailure, which closes the connection instead.
  */
 template <typename Req, typename Resp = Req>
 class PipelinedServerDispatcher : public HandlerAdapter<Req, Resp> {
@@ -54,33 +155,117 @@ class PipelinedServerDispatcher : public HandlerAdapter<Req, Resp> {
 
   typedef typename HandlerAdapter<Req, Resp>::Context Context;
 
-  explicit PipelinedServerDispatcher(Service<Req, Resp>* service)
-      : service_(service) {}
-
-  void read(Context*, Req in) override {
-    auto requestId = requestId_++;
-    (*service_)(std::move(in)).then([requestId,this](Resp& resp){
-      responses_[requestId] = resp;
-      sendResponses();
-    });
+  explicit PipelinedServerDispatcher(Service<Req, Resp>* service,
+                                     size_t maxInFlight = 128,
+                                     bool closeOnFailure = false)
+      : service_(service)
+      , maxInFlight_(maxInFlight)
+      , closeOnFailure_(closeOnFailure)
+      , responses_(maxInFlight) {
+    CHECK_GT(maxInFlight_, 0);
   }
 
-  void sendResponses() {
-    auto search = responses_.find(lastWrittenId_+1);
-    while (search != responses_.end()) {
-      Resp resp = std::move(search->second);
-      responses_.erase(search->first);
-      this->getContext()->fireWrite(std::move(resp));
-      lastWrittenId_++;
-      search = responses_.find(lastWrittenId_+1);
+  void read(Context* ctx, Req in) override {
+    if (closed_) {
+      return;
+    }
+    queue_.push_back(std::move(in));
+    if (getInFlight() + queue_.size() >= maxInFlight_) {
+      pauser_.pause(ctx);
     }
+    run(ctx);
+  }
+
+  void transportInactive(Context* ctx) override {
+    pauser_.cancel();
+    ctx->fireTransportInactive();
+  }
+
+  size_t getInFlight() const {
+    return nextRequestId_ - nextResponseId_;
   }
 
  private:
+  // Writes the responses that are next in order and passes queued requests
+  // to the service while there is room.  Responses that are ready
+  // immediately come back through here, so it does not recurse.
+  void run(Context* ctx) {
+    if (running_ || closed_) {
+      return;
+    }
+    running_ = true;
+    while (true) {
+      auto& slot = responses_[nextResponseId_ % maxInFlight_];
+      if (nextResponseId_ < nextRequestId_ && slot.hasValue()) {
+        auto resp = std::move(*slot);
+        slot.clear();
+        nextResponseId_++;
+        if (resp.hasValue()) {
+          ctx->fireWrite(std::move(resp.value()));
+        } else if (!closeOnFailure_) {
+          ctx->fireReadException(std::move(resp.exception()));
+        } else {
+          // Closing may destroy this handler
+          closed_ = true;
+          queue_.clear();
+          ctx->fireClose();
+          return;
+        }
+      } else if (!queue_.empty() && getInFlight() < maxInFlight_) {
+        auto in = std::move(queue_.front());
+        queue_.pop_front();
+        dispatch(ctx, std::move(in));
+      } else {
+        break;
+      }
+    }
+    running_ = false;
+
+    if (pauser_.isPaused() &&
+        getInFlight() + queue_.size() <= maxInFlight_ / 2) {
+      pauser_.resume();
+    }
+  }
+
+  void dispatch(Context* ctx, Req in) {
+    auto requestId = nextRequestId_++;
+    auto f = folly::makeFutureWith([&] { return (*service_)(std::move(in)); });
+    if (f.isReady()) {
+      responses_[requestId % maxInFlight_] = std::move(f.getTry());
+      return;
+    }
+
+    auto transport = ctx->getTransport();
+    auto evb = transport && transport->getEventBase()
+      ? transport->getEventBase()
+      : folly::EventBaseManager::get()->getEventBase();
+    std::weak_ptr<bool> alive = alive_;
+    std::move(f).via(evb).thenTry(
+      [this, alive, ctx, requestId](folly::Try<Resp> t) {
+        if (alive.lock()) {
+          responses_[requestId % maxInFlight_] = std::move(t);
+          run(ctx);
+        }
+      });
+  }
+
   Service<Req, Resp>* service_;
-  uint32_t requestId_{1};
-  std::unordered_map<uint32_t, Resp> responses_;
-  uint32_t lastWrittenId_{0};
+  size_t maxInFlight_;
+  bool closeOnFailure_;
+
+  // Completed responses of the requests in flight; request n's goes into
+  // slot n % maxInFlight_
+  std::vector<folly::Optional<folly::Try<Resp>>> responses_;
+  uint64_t nextRequestId_{0};
+  uint64_t nextResponseId_{0};
+
+  std::deque<Req> queue_;
+  bool running_{false};
+  bool closed_{false};
+  ReadPauser pauser_;
+
+  // Guards callbacks that complete after the handler is destroyed
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
 };
 
 /**
@@ -89,6 +274,12 @@ class PipelinedServerDispatcher : public HandlerAdapter<Req, Resp> {
  * by the pipeline.  Unlike a multiplexed client dispatcher, a
  * multiplexed server dispatcher needs no state, and the sequence id's
  * can just be copied from the request to the response in the pipeline.
+ *
+ * Failed requests get no response, unless the dispatcher is given
+ * getRequestId, which reads the id off a request, and errorResponse, which
+ * builds the response for a failure of the request with that id.  Then
+ * requests rejected by a filter such as QueueingFilter are answered at
+ * once, and the client need not wait for its own timeout.
  */
 template <typename Req, typename Resp = Req>
 class MultiplexServerDispatcher : public HandlerAdapter<Req, Resp> {
@@ -99,14 +290,40 @@ class MultiplexServerDispatcher : public HandlerAdapter<Req, Resp> {
   explicit MultiplexServerDispatcher(Service<Req, Resp>* service)
       : service_(service) {}
 
+  MultiplexServerDispatcher(
+      Service<Req, Resp>* service,
+      std::function<uint64_t(const Req&)> getRequestId,
+      std::function<Resp(uint64_t, folly::exception_wrapper)> errorResponse)
+      : service_(service)
+      , getRequestId_(std::move(getRequestId))
+      , errorResponse_(std::move(errorResponse)) {
+    CHECK(getRequestId_);
+    CHECK(errorResponse_);
+  }
+
   void read(Context* ctx, Req in) override {
-    (*service_)(std::move(in)).thenValue([ctx](Resp resp) {
-      ctx->fireWrite(std::move(resp));
-    });
+    if (!errorResponse_) {
+      (*service_)(std::move(in)).thenValue([ctx](Resp resp) {
+        ctx->fireWrite(std::move(resp));
+      });
+      return;
+    }
+
+    auto id = getRequestId_(in);
+    (*service_)(std::move(in)).thenTry(
+      [ctx, id, errorResponse = errorResponse_](folly::Try<Resp> t) {
+        if (t.hasException()) {
+          ctx->fireWrite(errorResponse(id, std::move(t.exception())));
+        } else {
+          ctx->fireWrite(std::move(t.value()));
+        }
+      });
   }
 
  private:
   Service<Req, Resp>* service_;
+  std::function<uint64_t(const Req&)> getRequestId_;
+  std::function<Resp(uint64_t, folly::exception_wrapper)> errorResponse_;
 };
 
 } // namespace wangle
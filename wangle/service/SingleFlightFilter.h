@@ -0,0 +1,112 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <folly/container/F14Map.h>
+#include <folly/futures/SharedPromise.h>
+#include <folly/hash/Hash.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * A service filter that lets only one request per key reach the service at
+ * a time.  Requests whose key matches a request already in flight are not
+ * sent; they get the in flight request's response instead.  Useful in
+ * front of backends that see storms of identical requests, such as after a
+ * cache miss.
+ *
+ * The in flight table is split into shards by key hash, each with its own
+ * lock, so concurrent requests for different keys rarely contend.  Resp
+ * must be copyable, as every caller gets its own copy.
+ */
+template <typename Req, typename Resp = Req, typename Key = Req>
+class SingleFlightFilter : public ServiceFilter<Req, Resp> {
+ public:
+  SingleFlightFilter(
+      std::shared_ptr<Service<Req, Resp>> service,
+      std::function<Key(const Req&)> getKey,
+      size_t numShards = 16)
+      : ServiceFilter<Req, Resp>(service)
+      , getKey_(std::move(getKey))
+      , shards_(std::make_shared<std::vector<Shard>>(numShards)) {
+    CHECK(getKey_);
+    CHECK_GT(numShards, 0);
+  }
+
+  folly::Future<Resp> operator()(Req req) override {
+    auto key = getKey_(req);
+    auto index = folly::hasher<Key>()(key) % shards_->size();
+    auto& shard = (*shards_)[index];
+    auto promise = std::make_shared<folly::SharedPromise<Resp>>();
+    {
+      std::lock_guard<std::mutex> g(shard.mutex);
+      auto it = shard.inFlight.find(key);
+      if (it != shard.inFlight.end()) {
+        coalesced_++;
+        return it->second->getFuture();
+      }
+      shard.inFlight.emplace(key, promise);
+    }
+
+    auto f = promise->getFuture();
+    // A service that throws rather than returning a failed future must
+    // still clear its entry, or the key would be stuck forever
+    folly::makeFutureWith([&] { return (*this->service_)(std::move(req)); })
+      .thenTry([shards = shards_, index, key = std::move(key), promise](
+                   folly::Try<Resp> t) mutable {
+        // Forget the request first, so requests made once it has completed
+        // go to the service
+        {
+          auto& s = (*shards)[index];
+          std::lock_guard<std::mutex> g(s.mutex);
+          auto it = s.inFlight.find(key);
+          if (it != s.inFlight.end() && it->second == promise) {
+            s.inFlight.erase(it);
+          }
+        }
+        promise->setTry(std::move(t));
+      });
+    return f;
+  }
+
+  /**
+   * The number of requests answered by another request's response.
+   */
+  uint64_t getCoalesced() const {
+    return coalesced_;
+  }
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    folly::F14FastMap<Key, std::shared_ptr<folly::SharedPromise<Resp>>>
+      inFlight;
+  };
+
+  std::function<Key(const Req&)> getKey_;
+  // Shared with outstanding requests, which may outlive the filter
+  std::shared_ptr<std::vector<Shard>> shards_;
+  std::atomic<uint64_t> coalesced_{0};
+};
+
+} // namespace wangle
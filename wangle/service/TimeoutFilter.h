@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <wangle/service/Deadline.h>
+#include <wangle/service/Service.h>
+
+namespace wangle {
+
+/**
+ * A service filter that fails requests with folly::FutureTimeout if the
+ * service has not responded within timeout, or by the request's Deadline if
+ * that is sooner.  A response arriving after the timeout is discarded.
+ *
+ * Timeouts are intrusive callbacks on the HHWheelTimer of evb (by default
+ * the EventBase of the calling thread), so a deadline costs no thread hop
+ * or extra future.  Requests must be made from evb's thread; responses that
+ * complete on another thread are handed back to it.
+ */
+template <typename Req, typename Resp = Req>
+class TimeoutFilter : public ServiceFilter<Req, Resp> {
+ public:
+  TimeoutFilter(std::shared_ptr<Service<Req, Resp>> service,
+                std::chrono::milliseconds timeout,
+                folly::EventBase* evb = nullptr)
+      : ServiceFilter<Req, Resp>(service)
+      , timeout_(timeout)
+      , evb_(evb ? evb : folly::EventBaseManager::get()->getEventBase()) {}
+
+  folly::Future<Resp> operator()(Req req) override {
+    DCHECK(evb_->isInEventBaseThread());
+    auto f = (*this->service_)(std::move(req));
+    auto timeout = Deadline::bound(timeout_);
+    if (f.isReady() || timeout.count() <= 0) {
+      return f;
+    }
+
+    auto request = std::make_shared<PendingRequest>();
+    auto result = request->promise.getFuture();
+    evb_->timer().scheduleTimeout(request.get(), timeout);
+    std::move(f).thenTry(
+      [evb = evb_, request = std::move(request)](folly::Try<Resp> t) mutable {
+        if (evb->isInEventBaseThread()) {
+          request->complete(std::move(t));
+        } else {
+          evb->runInEventBaseThread(
+            [request = std::move(request), t = std::move(t)]() mutable {
+              request->complete(std::move(t));
+            });
+        }
+      });
+    return result;
+  }
+
+ private:
+  // Owned by the continuation on the service's future, which outlives the
+  // timeout: destroying the callback cancels it
+  struct PendingRequest : public folly::HHWheelTimer::Callback {
+    void timeoutExpired() noexcept override {
+      promise.setException(folly::FutureTimeout());
+    }
+
+    void complete(folly::Try<Resp> t) {
+      if (!promise.isFulfilled()) {
+        cancelTimeout();
+        promise.setTry(std::move(t));
+      }
+    }
+
+    folly::Promise<Resp> promise;
+  };
+
+  std::chrono::milliseconds timeout_;
+  folly::EventBase* evb_;
+};
+
+} // namespace wangle
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <atomic>
+#include <mutex>
+
+#include <wangle/codec/LengthFieldBasedFrameDecoder.h>
+#include <wangle/codec/LengthFieldPrepender.h>
+#include <wangle/codec/StringCodec.h>
+#include <wangle/service/ClientDispatcher.h>
+#include <wangle/service/ConnectionPoolService.h>
+#include <wangle/service/ServerDispatcher.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Pipeline<IOBufQueue&, std::string> StringPipeline;
+
+class CountingEchoService : public Service<std::string, std::string> {
+ public:
+  Future<std::string> operator()(std::string req) override {
+    requests++;
+    return req;
+  }
+
+  std::atomic<size_t> requests{0};
+};
+
+// Gives each connection its own counting echo service, and keeps track of
+// the connections so that tests can break them
+class ServerPipelineFactory : public PipelineFactory<StringPipeline> {
+ public:
+  StringPipeline::Ptr newPipeline(
+      std::shared_ptr<AsyncTransportWrapper> socket) override {
+    auto service = std::make_shared<CountingEchoService>();
+    auto pipeline = StringPipeline::create();
+    pipeline->addBack(AsyncSocketHandler(socket));
+    pipeline->addBack(LengthFieldBasedFrameDecoder());
+    pipeline->addBack(LengthFieldPrepender());
+    pipeline->addBack(StringCodec());
+    pipeline->addBack(PipelinedServerDispatcher<std::string>(service.get()));
+    pipeline->finalize();
+
+    std::lock_guard<std::mutex> g(mutex_);
+    connections_.push_back({service, pipeline, socket->getEventBase()});
+    return pipeline;
+  }
+
+  // Requests served by each connection, in the order they were accepted
+  std::vector<size_t> getRequestCounts() {
+    std::lock_guard<std::mutex> g(mutex_);
+    std::vector<size_t> counts;
+    for (auto& conn : connections_) {
+      counts.push_back(conn.service->requests);
+    }
+    return counts;
+  }
+
+  // Closes the i-th connection from the server side
+  void closeConnection(size_t i) {
+    Connection conn;
+    {
+      std::lock_guard<std::mutex> g(mutex_);
+      conn = connections_.at(i);
+    }
+    conn.evb->runInEventBaseThreadAndWait([&] {
+      if (auto pipeline = conn.pipeline.lock()) {
+        pipeline->close();
+      }
+    });
+  }
+
+ private:
+  struct Connection {
+    std::shared_ptr<CountingEchoService> service;
+    std::weak_ptr<StringPipeline> pipeline;
+    EventBase* evb;
+  };
+
+  std::mutex mutex_;
+  std::vector<Connection> connections_;
+};
+
+class ClientPipelineFactory : public PipelineFactory<StringPipeline> {
+ public:
+  StringPipeline::Ptr newPipeline(
+      std::shared_ptr<AsyncTransportWrapper> socket) override {
+    auto pipeline = StringPipeline::create();
+    pipeline->addBack(AsyncSocketHandler(socket));
+    pipeline->addBack(LengthFieldBasedFrameDecoder());
+    pipeline->addBack(LengthFieldPrepender());
+    pipeline->addBack(StringCodec());
+    pipeline->finalize();
+    return pipeline;
+  }
+};
+
+class ClientServiceFactory
+    : public ServiceFactory<StringPipeline, std::string, std::string> {
+ public:
+  class ClientService : public Service<std::string, std::string> {
+   public:
+    explicit ClientService(StringPipeline* pipeline) {
+      dispatcher_.setPipeline(pipeline);
+    }
+    Future<std::string> operator()(std::string request) override {
+      return dispatcher_(std::move(request));
+    }
+   private:
+    PipelinedClientDispatcher<StringPipeline, std::string> dispatcher_;
+  };
+
+  Future<std::shared_ptr<Service<std::string, std::string>>> operator()(
+      std::shared_ptr<ClientBootstrap<StringPipeline>> client) override {
+    return std::shared_ptr<Service<std::string, std::string>>(
+      std::make_shared<ClientService>(client->getPipeline()));
+  }
+};
+
+typedef ConnectionPoolService<StringPipeline, std::string> StringPool;
+
+std::unique_ptr<StringPool> makePool(std::vector<SocketAddress> endpoints,
+                                     ConnectionPoolOptions options = {}) {
+  return std::make_unique<StringPool>(
+    std::move(endpoints),
+    std::make_shared<ClientPipelineFactory>(),
+    std::make_shared<ClientServiceFactory>(),
+    options);
+}
+
+} // namespace
+
+TEST(ConnectionPoolService, SpreadsRequests) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  auto factory = std::make_shared<ServerPipelineFactory>();
+  ServerBootstrap<StringPipeline> server;
+  server.childPipeline(factory);
+  server.bind(0);
+  SocketAddress addr;
+  server.getSockets()[0]->getAddress(&addr);
+
+  ConnectionPoolOptions options;
+  options.connectionsPerEndpoint = 2;
+  auto pool = makePool({addr, addr}, options);
+
+  // Nothing is connected yet, so this waits
+  auto first = (*pool)("first");
+  while (!first.isReady()) {
+    evb->loopOnce();
+  }
+  EXPECT_EQ("first", first.value());
+  while (pool->getConnectedCount() < 4) {
+    evb->loopOnce();
+  }
+
+  std::vector<Future<std::string>> futures;
+  for (int i = 0; i < 100; i++) {
+    futures.push_back((*pool)(folly::to<std::string>(i)));
+  }
+  for (int i = 0; i < 100; i++) {
+    while (!futures[i].isReady()) {
+      evb->loopOnce();
+    }
+    EXPECT_EQ(folly::to<std::string>(i), futures[i].value());
+  }
+
+  // Picking the less loaded of two keeps all four connections within a
+  // few requests of an even share, plus the first request on one of them
+  auto counts = factory->getRequestCounts();
+  ASSERT_EQ(4, counts.size());
+  for (auto count : counts) {
+    EXPECT_GE(count, 20);
+    EXPECT_LE(count, 31);
+  }
+
+  auto& stats = pool->getStats();
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(100, stats.hits);
+  EXPECT_EQ(101, stats.completed);
+  EXPECT_EQ(4, stats.connects);
+  EXPECT_LE(stats.meanLatency(), stats.maxLatency);
+  EXPECT_TRUE(pool->isAvailable());
+
+  pool->close();
+  EXPECT_FALSE(pool->isAvailable());
+  EXPECT_TRUE((*pool)("closed").getTry().hasException());
+  server.stop();
+}
+
+TEST(ConnectionPoolService, ConnectFailure) {
+  auto evb = EventBaseManager::get()->getEventBase();
+
+  // Grab a free port, then close it
+  SocketAddress addr;
+  {
+    ServerBootstrap<StringPipeline> server;
+    server.childPipeline(std::make_shared<ServerPipelineFactory>());
+    server.bind(0);
+    server.getSockets()[0]->getAddress(&addr);
+    server.stop();
+  }
+
+  ConnectionPoolOptions options;
+  options.connectionsPerEndpoint = 1;
+  auto pool = makePool({addr}, options);
+  auto f = (*pool)("request");
+  while (!f.isReady()) {
+    evb->loopOnce();
+  }
+  EXPECT_TRUE(f.getTry().hasException());
+  EXPECT_EQ(1, pool->getStats().connectFailures);
+  EXPECT_FALSE(pool->isAvailable());
+}
+
+TEST(ConnectionPoolService, ReconnectsBrokenConnection) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  auto factory = std::make_shared<ServerPipelineFactory>();
+  ServerBootstrap<StringPipeline> server;
+  server.childPipeline(factory);
+  server.bind(0);
+  SocketAddress addr;
+  server.getSockets()[0]->getAddress(&addr);
+
+  ConnectionPoolOptions options;
+  options.connectionsPerEndpoint = 1;
+  options.minReconnectDelay = std::chrono::milliseconds(10);
+  auto pool = makePool({addr}, options);
+  auto first = (*pool)("first");
+  while (!first.isReady()) {
+    evb->loopOnce();
+  }
+  EXPECT_EQ("first", first.value());
+
+  factory->closeConnection(0);
+  while (pool->getConnectedCount() != 0) {
+    evb->loopOnce();
+  }
+  EXPECT_FALSE(pool->isAvailable());
+
+  // Reconnected in the background after the backoff delay
+  while (pool->getStats().connects < 2) {
+    evb->loopOnce();
+  }
+  EXPECT_EQ(1, pool->getConnectedCount());
+  auto second = (*pool)("second");
+  while (!second.isReady()) {
+    evb->loopOnce();
+  }
+  EXPECT_EQ("second", second.value());
+  EXPECT_EQ(std::vector<size_t>({1, 1}), factory->getRequestCounts());
+  EXPECT_EQ(0, pool->getStats().connectFailures);
+
+  pool->close();
+  server.stop();
+}
@@ -0,0 +1,537 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <folly/Conv.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+#include <wangle/channel/AsyncSocketHandler.h>
+#include <wangle/codec/LineBasedFrameDecoder.h>
+#include <wangle/service/ClientDispatcher.h>
+#include <wangle/service/QueueingFilter.h>
+#include <wangle/service/ServerDispatcher.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+struct Message {
+  uint64_t id{0};
+  std::string body;
+};
+
+typedef Pipeline<Message, Message> MessagePipeline;
+
+class WriteCollector : public OutboundHandler<Message> {
+ public:
+  Future<Unit> write(Context*, Message msg) override {
+    writes.push_back(std::move(msg));
+    return makeFuture();
+  }
+
+  Future<Unit> close(Context*) override {
+    closes++;
+    return makeFuture();
+  }
+
+  std::vector<Message> writes;
+  int closes{0};
+};
+
+// Counts the read exceptions that reach the end of the pipeline
+class ExceptionCollector : public InboundHandler<Message> {
+ public:
+  void read(Context*, Message) override {}
+
+  void readException(Context*, exception_wrapper) override {
+    exceptions++;
+  }
+
+  int exceptions{0};
+};
+
+typedef MultiplexClientDispatcher<MessagePipeline, Message>
+  MessageClientDispatcher;
+
+std::unique_ptr<MessageClientDispatcher> makeClientDispatcher(
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(0)) {
+  return std::make_unique<MessageClientDispatcher>(
+    [](Message& msg, uint64_t id) { msg.id = id; },
+    [](const Message& msg) { return msg.id; },
+    timeout);
+}
+
+// Completes requests when the test says so
+class ManualService : public Service<Message, Message> {
+ public:
+  Future<Message> operator()(Message req) override {
+    requests.push_back(req);
+    promises.emplace_back();
+    return promises.back().getFuture();
+  }
+
+  void reply(size_t i) {
+    auto msg = requests[i];
+    msg.body += " reply";
+    promises[i].setValue(std::move(msg));
+  }
+
+  void fail(size_t i) {
+    promises[i].setException(std::runtime_error("failed"));
+  }
+
+  std::vector<Message> requests;
+  std::vector<Promise<Message>> promises;
+};
+
+class EchoService : public Service<Message, Message> {
+ public:
+  Future<Message> operator()(Message req) override {
+    return req;
+  }
+};
+
+// Messages as "<id> <body>" lines, counting the messages read
+class LineMessageCodec : public Handler<std::unique_ptr<IOBuf>,
+                                        Message,
+                                        Message,
+                                        std::unique_ptr<IOBuf>> {
+ public:
+  void read(Context* ctx, std::unique_ptr<IOBuf> line) override {
+    auto str = line->moveToFbString().toStdString();
+    auto space = str.find(' ');
+    reads++;
+    ctx->fireRead(Message{folly::to<uint64_t>(str.substr(0, space)),
+                          str.substr(space + 1)});
+  }
+
+  Future<Unit> write(Context* ctx, Message msg) override {
+    return ctx->fireWrite(IOBuf::copyBuffer(
+      folly::to<std::string>(msg.id, " ", msg.body, "\n")));
+  }
+
+  size_t reads{0};
+};
+
+// A pipeline reading Messages from a connected socket through an
+// AsyncSocketHandler, to see whether reads get paused.  Responses go to
+// collector.
+class SocketPipeline {
+ public:
+  explicit SocketPipeline(EventBase* evb) : evb_(evb) {
+    CHECK_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds_));
+    socket = AsyncSocket::newSocket(evb, NetworkSocket::fromFd(fds_[0]));
+    pipeline = Pipeline<IOBufQueue&, Message>::create();
+    pipeline->addBack(AsyncSocketHandler(socket));
+    pipeline->addBack(LineBasedFrameDecoder());
+    pipeline->addBack(&codec_);
+    pipeline->addBack(&collector);
+  }
+
+  ~SocketPipeline() {
+    // Before the handlers it points to
+    pipeline.reset();
+    ::close(fds_[1]);
+  }
+
+  // Call once the dispatcher is added
+  void start() {
+    pipeline->finalize();
+    pipeline->transportActive();
+  }
+
+  // Sends lines in one write, returning once they have all been read
+  void send(std::vector<std::string> lines) {
+    std::string data;
+    for (auto& line : lines) {
+      data += line + "\n";
+    }
+    CHECK_EQ(ssize_t(data.size()), ::write(fds_[1], data.data(), data.size()));
+    sent_ += lines.size();
+    while (codec_.reads < sent_) {
+      evb_->loopOnce();
+    }
+  }
+
+  bool isReading() const {
+    return socket->getReadCallback() != nullptr;
+  }
+
+  Pipeline<IOBufQueue&, Message>::Ptr pipeline;
+  WriteCollector collector;
+  std::shared_ptr<AsyncSocket> socket;
+
+ private:
+  EventBase* evb_;
+  int fds_[2];
+  LineMessageCodec codec_;
+  size_t sent_{0};
+};
+
+void loopUntil(EventBase* evb, std::function<bool()> done) {
+  while (!done()) {
+    evb->loopOnce();
+  }
+}
+
+} // namespace
+
+TEST(MultiplexClientDispatcher, OutOfOrderResponses) {
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  auto dispatcher = makeClientDispatcher();
+  dispatcher->setPipeline(pipeline.get());
+
+  auto f1 = (*dispatcher)(Message{0, "one"});
+  auto f2 = (*dispatcher)(Message{0, "two"});
+  auto f3 = (*dispatcher)(Message{0, "three"});
+  ASSERT_EQ(3, collector.writes.size());
+  EXPECT_EQ(3, dispatcher->getOutstanding());
+
+  auto reply = [&](size_t i) {
+    auto msg = collector.writes[i];
+    msg.body += " reply";
+    pipeline->read(std::move(msg));
+  };
+  reply(2);
+  EXPECT_FALSE(f1.isReady());
+  EXPECT_EQ("three reply", f3.value().body);
+  reply(0);
+  EXPECT_EQ("one reply", f1.value().body);
+  reply(0);
+  EXPECT_FALSE(f2.isReady());
+  reply(1);
+  EXPECT_EQ("two reply", f2.value().body);
+  EXPECT_EQ(0, dispatcher->getOutstanding());
+}
+
+TEST(MultiplexClientDispatcher, FailOnEOF) {
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  auto dispatcher = makeClientDispatcher();
+  dispatcher->setPipeline(pipeline.get());
+
+  auto f1 = (*dispatcher)(Message{0, "one"});
+  auto f2 = (*dispatcher)(Message{0, "two"});
+  pipeline->readEOF();
+  EXPECT_TRUE(f1.getTry().hasException<AsyncSocketException>());
+  EXPECT_TRUE(f2.getTry().hasException<AsyncSocketException>());
+  EXPECT_EQ(0, dispatcher->getOutstanding());
+}
+
+TEST(MultiplexClientDispatcher, FailOnException) {
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  auto dispatcher = makeClientDispatcher();
+  dispatcher->setPipeline(pipeline.get());
+
+  auto f = (*dispatcher)(Message{0, "one"});
+  pipeline->readException(
+    make_exception_wrapper<std::runtime_error>("broken"));
+  EXPECT_TRUE(f.getTry().hasException<std::runtime_error>());
+}
+
+TEST(MultiplexClientDispatcher, Timeout) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  auto dispatcher = makeClientDispatcher(std::chrono::milliseconds(10));
+  dispatcher->setPipeline(pipeline.get());
+
+  auto f1 = (*dispatcher)(Message{0, "one"});
+  auto f2 = (*dispatcher)(Message{0, "two"});
+  pipeline->read(Message(collector.writes[1]));
+  EXPECT_EQ("two", f2.value().body);
+
+  while (!f1.isReady()) {
+    evb->loopOnce();
+  }
+  EXPECT_TRUE(f1.getTry().hasException<FutureTimeout>());
+
+  // A late response is dropped
+  pipeline->read(Message(collector.writes[0]));
+  EXPECT_EQ(0, dispatcher->getOutstanding());
+}
+
+TEST(SerialServerDispatcher, OneAtATime) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(SerialServerDispatcher<Message>(&service));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  pipeline->read(Message{3, "three"});
+  EXPECT_EQ(1, service.requests.size());
+
+  service.reply(0);
+  loopUntil(evb, [&] { return service.requests.size() == 2; });
+  ASSERT_EQ(1, collector.writes.size());
+  EXPECT_EQ("one reply", collector.writes[0].body);
+
+  service.reply(1);
+  loopUntil(evb, [&] { return service.requests.size() == 3; });
+  service.reply(2);
+  loopUntil(evb, [&] { return collector.writes.size() == 3; });
+  EXPECT_EQ("two reply", collector.writes[1].body);
+  EXPECT_EQ("three reply", collector.writes[2].body);
+}
+
+TEST(SerialServerDispatcher, ReadyResponsesInline) {
+  EchoService service;
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(SerialServerDispatcher<Message>(&service));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  ASSERT_EQ(2, collector.writes.size());
+  EXPECT_EQ("one", collector.writes[0].body);
+  EXPECT_EQ("two", collector.writes[1].body);
+}
+
+TEST(SerialServerDispatcher, PausesReads) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  SocketPipeline p(evb);
+  p.pipeline->addBack(SerialServerDispatcher<Message>(&service, 2));
+  p.start();
+
+  // One request in the service, two queued
+  p.send({"0 request", "1 request", "2 request"});
+  EXPECT_TRUE(p.isReading());
+  p.send({"3 request"});
+  EXPECT_FALSE(p.isReading());
+
+  // Resumes once no more than half as many are queued
+  service.reply(0);
+  loopUntil(evb, [&] { return service.requests.size() == 2; });
+  EXPECT_FALSE(p.isReading());
+  service.reply(1);
+  loopUntil(evb, [&] { return service.requests.size() == 3; });
+  EXPECT_TRUE(p.isReading());
+}
+
+namespace {
+
+class MoveOnlyService
+    : public Service<Message, std::unique_ptr<std::string>> {
+ public:
+  Future<std::unique_ptr<std::string>> operator()(Message req) override {
+    requests.push_back(req);
+    promises.emplace_back();
+    return promises.back().getFuture();
+  }
+
+  void reply(size_t i) {
+    promises[i].setValue(std::make_unique<std::string>(requests[i].body));
+  }
+
+  std::vector<Message> requests;
+  std::vector<Promise<std::unique_ptr<std::string>>> promises;
+};
+
+class MoveOnlyWriteCollector
+    : public OutboundHandler<std::unique_ptr<std::string>> {
+ public:
+  Future<Unit> write(Context*, std::unique_ptr<std::string> msg) override {
+    writes.push_back(*msg);
+    return makeFuture();
+  }
+
+  std::vector<std::string> writes;
+};
+
+} // namespace
+
+TEST(PipelinedServerDispatcher, InOrder) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  MoveOnlyService service;
+  MoveOnlyWriteCollector collector;
+  auto pipeline =
+    Pipeline<Message, std::unique_ptr<std::string>>::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(
+    PipelinedServerDispatcher<Message, std::unique_ptr<std::string>>(
+      &service));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  pipeline->read(Message{3, "three"});
+  EXPECT_EQ(3, service.requests.size());
+
+  service.reply(2);
+  service.reply(0);
+  loopUntil(evb, [&] { return collector.writes.size() == 1; });
+  service.reply(1);
+  loopUntil(evb, [&] { return collector.writes.size() == 3; });
+  EXPECT_EQ(std::vector<std::string>({"one", "two", "three"}),
+            collector.writes);
+}
+
+TEST(PipelinedServerDispatcher, BoundedInFlight) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  SocketPipeline p(evb);
+  p.pipeline->addBack(PipelinedServerDispatcher<Message>(&service, 2));
+  p.start();
+  auto& collector = p.collector;
+
+  p.send({"0 zero"});
+  EXPECT_TRUE(p.isReading());
+  // Read along with the request that pauses reads, so the second has to
+  // wait for room
+  p.send({"1 one", "2 two"});
+  EXPECT_FALSE(p.isReading());
+  EXPECT_EQ(2, service.requests.size());
+
+  service.reply(1);
+  service.reply(0);
+  loopUntil(evb, [&] { return collector.writes.size() == 2; });
+  EXPECT_EQ(3, service.requests.size());
+  EXPECT_TRUE(p.isReading());
+
+  service.reply(2);
+  loopUntil(evb, [&] { return collector.writes.size() == 3; });
+  EXPECT_EQ("zero reply", collector.writes[0].body);
+  EXPECT_EQ("one reply", collector.writes[1].body);
+  EXPECT_EQ("two reply", collector.writes[2].body);
+}
+
+TEST(SerialServerDispatcher, SurfacesFailures) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  WriteCollector collector;
+  ExceptionCollector exceptions;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(SerialServerDispatcher<Message>(&service));
+  pipeline->addBack(&exceptions);
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  service.fail(0);
+  loopUntil(evb, [&] { return service.requests.size() == 2; });
+  EXPECT_EQ(1, exceptions.exceptions);
+  service.reply(1);
+  loopUntil(evb, [&] { return collector.writes.size() == 1; });
+  EXPECT_EQ("two reply", collector.writes[0].body);
+  EXPECT_EQ(0, collector.closes);
+}
+
+TEST(SerialServerDispatcher, CloseOnFailure) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(SerialServerDispatcher<Message>(&service, 64, true));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  service.fail(0);
+  loopUntil(evb, [&] { return collector.closes == 1; });
+  EXPECT_EQ(1, service.requests.size());
+  EXPECT_TRUE(collector.writes.empty());
+}
+
+TEST(PipelinedServerDispatcher, SurfacesFailures) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  WriteCollector collector;
+  ExceptionCollector exceptions;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(PipelinedServerDispatcher<Message>(&service));
+  pipeline->addBack(&exceptions);
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  service.reply(1);
+  service.fail(0);
+  loopUntil(evb, [&] { return collector.writes.size() == 1; });
+  EXPECT_EQ(1, exceptions.exceptions);
+  EXPECT_EQ("two reply", collector.writes[0].body);
+  EXPECT_EQ(0, collector.closes);
+}
+
+TEST(PipelinedServerDispatcher, CloseOnFailure) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  ManualService service;
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(PipelinedServerDispatcher<Message>(&service, 128, true));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  service.reply(1);
+  service.fail(0);
+  loopUntil(evb, [&] { return collector.closes == 1; });
+  EXPECT_TRUE(collector.writes.empty());
+}
+
+TEST(MultiplexServerDispatcher, ErrorResponses) {
+  auto service = std::make_shared<ManualService>();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  options.maxQueueSize = 1;
+  QueueingFilter<Message> filter(service, options);
+  WriteCollector collector;
+  auto pipeline = MessagePipeline::create();
+  pipeline->addBack(&collector);
+  pipeline->addBack(MultiplexServerDispatcher<Message>(
+    &filter,
+    [](const Message& msg) { return msg.id; },
+    [](uint64_t id, exception_wrapper e) {
+      return Message{id, e.what().toStdString()};
+    }));
+  pipeline->finalize();
+
+  pipeline->read(Message{1, "one"});
+  pipeline->read(Message{2, "two"});
+  pipeline->read(Message{3, "three"});
+
+  // The request over the queue size is answered at once
+  ASSERT_EQ(1, collector.writes.size());
+  EXPECT_EQ(3, collector.writes[0].id);
+  EXPECT_NE(std::string::npos,
+            collector.writes[0].body.find("Queue overloaded"));
+
+  service->reply(0);
+  service->reply(1);
+  ASSERT_EQ(3, collector.writes.size());
+  EXPECT_EQ("one reply", collector.writes[1].body);
+  EXPECT_EQ("two reply", collector.writes[2].body);
+}
@@ -0,0 +1,758 @@
+/*
+ * Copyright 2017-present Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <deque>
+#include <functional>
+#include <thread>
+
+#include <folly/Conv.h>
+#include <folly/executors/ManualExecutor.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <wangle/service/BatchingFilter.h>
+#include <wangle/service/CachingFilter.h>
+#include <wangle/service/CloseOnReleaseFilter.h>
+#include <wangle/service/ConcurrencyLimitFilter.h>
+#include <wangle/service/DeadlineFilter.h>
+#include <wangle/service/ExecutorFilter.h>
+#include <wangle/service/ExpiringFilter.h>
+#include <wangle/service/HedgingFilter.h>
+#include <wangle/service/QueueingFilter.h>
+#include <wangle/service/SingleFlightFilter.h>
+#include <wangle/service/TimeoutFilter.h>
+
+using namespace folly;
+using namespace wangle;
+
+namespace {
+
+typedef Service<std::string, std::string> StringService;
+
+class EchoService : public StringService {
+ public:
+  Future<std::string> operator()(std::string req) override {
+    return req;
+  }
+};
+
+// Completes requests when the test says so
+class ManualService : public StringService {
+ public:
+  Future<std::string> operator()(std::string req) override {
+    requests.push_back(req);
+    promises.emplace_back();
+    return promises.back().getFuture();
+  }
+
+  Future<Unit> close() override {
+    closed = true;
+    return makeFuture();
+  }
+
+  std::vector<std::string> requests;
+  bool closed{false};
+  // A deque, so completing a promise may issue requests
+  std::deque<Promise<std::string>> promises;
+};
+
+// Throws instead of returning a future, counting the attempts
+class ThrowingService : public StringService {
+ public:
+  Future<std::string> operator()(std::string) override {
+    calls++;
+    throw std::runtime_error("thrown");
+  }
+
+  int calls{0};
+};
+
+// Echoes batches, recording their sizes
+class BatchEchoService
+    : public Service<std::vector<std::string>, std::vector<std::string>> {
+ public:
+  Future<std::vector<std::string>> operator()(
+      std::vector<std::string> reqs) override {
+    batches.push_back(reqs.size());
+    sent.push_back(std::chrono::steady_clock::now());
+    if (truncate) {
+      reqs.pop_back();
+    }
+    return reqs;
+  }
+
+  std::vector<size_t> batches;
+  std::vector<std::chrono::steady_clock::time_point> sent;
+  bool truncate{false};
+};
+
+// Runs evb for about duration
+void loopFor(EventBase& evb, std::chrono::milliseconds duration) {
+  evb.runAfterDelay([&] { evb.terminateLoopSoon(); }, duration.count());
+  evb.loopForever();
+}
+
+// Runs evb until done, giving up after a generous 10 seconds so that a
+// loaded machine only makes the test slower
+void loopUntil(EventBase& evb, std::function<bool()> done) {
+  auto start = std::chrono::steady_clock::now();
+  while (!done() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+} // namespace
+
+TEST(ExpiringFilter, ExpiringMax) {
+  EventBase evb;
+  std::shared_ptr<StringService> service = std::make_shared<EchoService>();
+  auto expiringService = std::make_shared<ExpiringFilter<std::string>>(
+    std::make_shared<CloseOnReleaseFilter<std::string>>(service),
+    std::chrono::milliseconds(0),
+    std::chrono::milliseconds(10),
+    &evb);
+
+  EXPECT_EQ("test", (*expiringService)("test").value());
+  loopUntil(evb, [&] {
+    return (*expiringService)("test").getTry().hasException();
+  });
+  EXPECT_TRUE((*expiringService)("test").getTry().hasException());
+}
+
+TEST(ExpiringFilter, ExpiringIdle) {
+  EventBase evb;
+  std::shared_ptr<StringService> service = std::make_shared<EchoService>();
+  auto expiringService = std::make_shared<ExpiringFilter<std::string>>(
+    std::make_shared<CloseOnReleaseFilter<std::string>>(service),
+    std::chrono::milliseconds(10),
+    std::chrono::milliseconds(0),
+    &evb);
+
+  loopUntil(evb, [&] {
+    return (*expiringService)("test").getTry().hasException();
+  });
+  EXPECT_TRUE((*expiringService)("test").getTry().hasException());
+}
+
+TEST(ExpiringFilter, NoIdleDuringRequests) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  auto expiringService = std::make_shared<ExpiringFilter<std::string>>(
+    std::make_shared<CloseOnReleaseFilter<std::string>>(service),
+    std::chrono::milliseconds(10),
+    std::chrono::milliseconds(0),
+    &evb);
+
+  // Ten times the idle timeout, without expiring
+  auto f = (*expiringService)("first");
+  loopFor(evb, std::chrono::milliseconds(100));
+  service->promises[0].setValue("first");
+  EXPECT_EQ("first", f.value());
+  auto g = (*expiringService)("second");
+  EXPECT_EQ(2, service->requests.size());
+
+  service->promises[1].setValue("second");
+  loopUntil(evb, [&] { return service->closed; });
+  EXPECT_TRUE((*expiringService)("third").getTry().hasException());
+}
+
+TEST(TimeoutFilter, Timeout) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  TimeoutFilter<std::string> filter(
+    service, std::chrono::milliseconds(10), &evb);
+
+  auto f = filter("request");
+  EXPECT_FALSE(f.isReady());
+  loopUntil(evb, [&] { return f.isReady(); });
+  EXPECT_TRUE(f.getTry().hasException<FutureTimeout>());
+
+  // A late response is discarded
+  service->promises[0].setValue("late");
+}
+
+TEST(TimeoutFilter, RespondsInTime) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  TimeoutFilter<std::string> filter(
+    service, std::chrono::milliseconds(10), &evb);
+
+  auto f = filter("request");
+  service->promises[0].setValue("response");
+  EXPECT_EQ("response", f.value());
+  EXPECT_EQ(0, evb.timer().count());
+}
+
+TEST(TimeoutFilter, ReadyPassesThrough) {
+  EventBase evb;
+  TimeoutFilter<std::string> filter(
+    std::make_shared<EchoService>(), std::chrono::milliseconds(10), &evb);
+
+  EXPECT_EQ("request", filter("request").value());
+  EXPECT_EQ(0, evb.timer().count());
+}
+
+TEST(ConcurrencyLimitFilter, RejectsOverLimit) {
+  auto service = std::make_shared<ManualService>();
+  ConcurrencyLimitOptions options;
+  options.initialLimit = 2;
+  ConcurrencyLimitFilter<std::string> filter(service, options);
+
+  auto f1 = filter("one");
+  EXPECT_TRUE(filter.isAvailable());
+  auto f2 = filter("two");
+  EXPECT_FALSE(filter.isAvailable());
+  auto f3 = filter("three");
+  EXPECT_TRUE(f3.getTry().hasException<ConcurrencyLimitExceeded>());
+  EXPECT_EQ(2, service->requests.size());
+  EXPECT_EQ(1, filter.getRejected());
+
+  service->promises[0].setValue("one");
+  EXPECT_EQ("one", f1.value());
+  EXPECT_EQ(1, filter.getInFlight());
+  EXPECT_TRUE(filter.isAvailable());
+}
+
+TEST(ConcurrencyLimitFilter, FailuresShrinkLimit) {
+  auto service = std::make_shared<ManualService>();
+  ConcurrencyLimitOptions options;
+  options.initialLimit = 10;
+  options.minLimit = 2;
+  options.backoffRatio = 0.5;
+  ConcurrencyLimitFilter<std::string> filter(service, options);
+
+  for (size_t i = 0; i < 3; i++) {
+    auto f = filter("request");
+    service->promises[i].setException(std::runtime_error("overloaded"));
+    EXPECT_TRUE(f.getTry().hasException<std::runtime_error>());
+  }
+  // 10 -> 5 -> 2.5 -> 2 (minLimit)
+  EXPECT_EQ(2, filter.getLimit());
+}
+
+TEST(ConcurrencyLimitFilter, GrowsWhenUsed) {
+  auto service = std::make_shared<EchoService>();
+  ConcurrencyLimitOptions options;
+  options.initialLimit = 1;
+  options.smoothing = 1;
+  ConcurrencyLimitFilter<std::string> filter(service, options);
+
+  // Requests complete immediately, so latency stays at the no-load
+  // latency, give or take the gradient's lower bound of 0.5
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ("request", filter("request").value());
+  }
+  EXPECT_GT(filter.getLimit(), 1);
+}
+
+TEST(ConcurrencyLimitFilter, WindowedMinRtt) {
+  auto service = std::make_shared<ManualService>();
+  std::chrono::steady_clock::time_point now;
+  ConcurrencyLimitOptions options;
+  options.minRttWindow = 2;
+  options.clock = [&] { return now; };
+  ConcurrencyLimitFilter<std::string> filter(service, options);
+
+  auto request = [&](std::chrono::milliseconds rtt) {
+    auto f = filter("request");
+    now += rtt;
+    service->promises.back().setValue("response");
+    EXPECT_EQ("response", f.value());
+    return filter.getMinRtt();
+  };
+  using std::chrono::milliseconds;
+  EXPECT_EQ(milliseconds(10), request(milliseconds(10)));
+  // One slow response does not replace the minimum
+  EXPECT_EQ(milliseconds(10), request(milliseconds(100)));
+  EXPECT_EQ(milliseconds(10), request(milliseconds(100)));
+  EXPECT_EQ(milliseconds(10), request(milliseconds(100)));
+  // Until the window with the fast response has aged out
+  EXPECT_EQ(milliseconds(100), request(milliseconds(100)));
+  EXPECT_EQ(milliseconds(50), request(milliseconds(50)));
+}
+
+TEST(BatchingFilter, FlushesAtMaxBatchSize) {
+  EventBase evb;
+  auto service = std::make_shared<BatchEchoService>();
+  BatchingFilter<std::string> filter(
+    service, 2, std::chrono::microseconds(0), &evb);
+
+  auto f1 = filter("a");
+  EXPECT_TRUE(service->batches.empty());
+  auto f2 = filter("b");
+  auto f3 = filter("c");
+  EXPECT_EQ(std::vector<size_t>({2}), service->batches);
+  EXPECT_EQ("a", f1.value());
+  EXPECT_EQ("b", f2.value());
+  EXPECT_FALSE(f3.isReady());
+
+  evb.loopOnce();
+  EXPECT_EQ(std::vector<size_t>({2, 1}), service->batches);
+  EXPECT_EQ("c", f3.value());
+}
+
+TEST(BatchingFilter, FlushesAfterDelay) {
+  EventBase evb;
+  auto service = std::make_shared<BatchEchoService>();
+  BatchingFilter<std::string> filter(
+    service, 64, std::chrono::microseconds(2500), &evb);
+
+  auto start = std::chrono::steady_clock::now();
+  auto f1 = filter("a");
+  auto f2 = filter("b");
+  loopUntil(evb, [&] { return !service->batches.empty(); });
+  EXPECT_EQ(std::vector<size_t>({2}), service->batches);
+  // Never sent early, however loaded the machine
+  EXPECT_GE(service->sent[0] - start, std::chrono::microseconds(2500));
+  EXPECT_EQ("a", f1.value());
+  EXPECT_EQ("b", f2.value());
+}
+
+TEST(BatchingFilter, MismatchFailsBatch) {
+  auto service = std::make_shared<BatchEchoService>();
+  service->truncate = true;
+  BatchingFilter<std::string> filter(service, 2);
+
+  auto f1 = filter("a");
+  auto f2 = filter("b");
+  EXPECT_TRUE(f1.getTry().hasException());
+  EXPECT_TRUE(f2.getTry().hasException());
+}
+
+TEST(SingleFlightFilter, CoalescesDuplicates) {
+  auto service = std::make_shared<ManualService>();
+  SingleFlightFilter<std::string> filter(
+    service, [](const std::string& req) { return req; });
+
+  auto f1 = filter("a");
+  auto f2 = filter("a");
+  auto f3 = filter("b");
+  EXPECT_EQ(std::vector<std::string>({"a", "b"}), service->requests);
+  EXPECT_EQ(1, filter.getCoalesced());
+
+  service->promises[0].setValue("A");
+  EXPECT_EQ("A", f1.value());
+  EXPECT_EQ("A", f2.value());
+  EXPECT_FALSE(f3.isReady());
+
+  // Completed requests are not reused
+  auto f4 = filter("a");
+  EXPECT_EQ(3, service->requests.size());
+  service->promises[2].setException(std::runtime_error("failed"));
+  EXPECT_TRUE(f4.getTry().hasException());
+}
+
+TEST(SingleFlightFilter, KeyExtractor) {
+  auto service = std::make_shared<ManualService>();
+  SingleFlightFilter<std::string, std::string, char> filter(
+    service, [](const std::string& req) { return req.at(0); });
+
+  auto f1 = filter("ab");
+  auto f2 = filter("ac");
+  EXPECT_EQ(1, service->requests.size());
+  service->promises[0].setValue("x");
+  EXPECT_EQ("x", f2.value());
+}
+
+TEST(SingleFlightFilter, SynchronousThrow) {
+  auto service = std::make_shared<ThrowingService>();
+  SingleFlightFilter<std::string> filter(
+    service, [](const std::string& req) { return req; });
+
+  EXPECT_TRUE(filter("a").getTry().hasException());
+  // The failed request is forgotten, so the next one reaches the service
+  EXPECT_TRUE(filter("a").getTry().hasException());
+  EXPECT_EQ(2, service->calls);
+  EXPECT_EQ(0, filter.getCoalesced());
+}
+
+TEST(CachingFilter, CachesUntilTtl) {
+  auto service = std::make_shared<ManualService>();
+  CachingFilterOptions options;
+  options.ttl = std::chrono::seconds(1);
+  CachingFilter<std::string> filter(
+    service,
+    [](const std::string& req) { return req; },
+    [](const std::string& resp) { return resp.size(); },
+    options);
+
+  auto f1 = filter("a");
+  service->promises[0].setValue("A");
+  EXPECT_EQ("A", f1.value());
+  EXPECT_EQ("A", filter("a").value());
+  EXPECT_EQ(1, service->requests.size());
+  EXPECT_EQ(1, filter.getHits());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  auto f2 = filter("a");
+  EXPECT_FALSE(f2.isReady());
+  EXPECT_EQ(2, service->requests.size());
+  EXPECT_EQ(2, filter.getMisses());
+}
+
+TEST(CachingFilter, StaleWhileRevalidate) {
+  auto service = std::make_shared<ManualService>();
+  CachingFilterOptions options;
+  options.ttl = std::chrono::milliseconds(10);
+  options.staleTtl = std::chrono::seconds(10);
+  CachingFilter<std::string> filter(
+    service,
+    [](const std::string& req) { return req; },
+    [](const std::string& resp) { return resp.size(); },
+    options);
+
+  filter("a");
+  service->promises[0].setValue("A");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  // Stale responses are returned while one request refreshes them
+  EXPECT_EQ("A", filter("a").value());
+  EXPECT_EQ("A", filter("a").value());
+  EXPECT_EQ(2, service->requests.size());
+  EXPECT_EQ(2, filter.getStaleHits());
+
+  service->promises[1].setValue("B");
+  EXPECT_EQ("B", filter("a").value());
+  EXPECT_EQ(2, service->requests.size());
+}
+
+TEST(CachingFilter, ByteBudget) {
+  auto service = std::make_shared<EchoService>();
+  CachingFilterOptions options;
+  options.maxBytes = 10;
+  options.numShards = 1;
+  CachingFilter<std::string> filter(
+    service,
+    [](const std::string& req) { return req; },
+    [](const std::string& resp) { return resp.size(); },
+    options);
+
+  filter("aaaaa");
+  filter("bbbbb");
+  EXPECT_EQ(10, filter.getBytes());
+  filter("cc");
+  EXPECT_EQ(7, filter.getBytes());
+
+  // The least recently used response was evicted
+  filter("bbbbb");
+  EXPECT_EQ(1, filter.getHits());
+  filter("aaaaa");
+  EXPECT_EQ(4, filter.getMisses());
+}
+
+TEST(HedgingFilter, HedgesSlowRequest) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  HedgingOptions options;
+  options.initialDelay = std::chrono::milliseconds(10);
+  HedgingFilter<std::string> filter(service, options, &evb);
+
+  auto f = filter("a");
+  EXPECT_EQ(1, service->requests.size());
+  loopUntil(evb, [&] { return service->requests.size() == 2; });
+  EXPECT_EQ(2, service->requests.size());
+
+  service->promises[1].setValue("hedge");
+  EXPECT_EQ("hedge", f.value());
+  service->promises[0].setValue("late");
+  EXPECT_EQ(1, filter.getStats().hedges);
+  EXPECT_EQ(1, filter.getStats().hedgeWins);
+}
+
+TEST(HedgingFilter, BudgetLimitsHedges) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  HedgingOptions options;
+  options.initialDelay = std::chrono::milliseconds(10);
+  options.budgetRatio = 0;
+  options.maxTokens = 1;
+  HedgingFilter<std::string> filter(service, options, &evb);
+
+  auto f1 = filter("a");
+  auto f2 = filter("b");
+  loopUntil(evb, [&] { return filter.getStats().budgetExhausted == 1; });
+  EXPECT_EQ(3, service->requests.size());
+  EXPECT_EQ(1, filter.getStats().hedges);
+  EXPECT_EQ(1, filter.getStats().budgetExhausted);
+  EXPECT_DOUBLE_EQ(0.5, filter.getStats().hedgeRate());
+}
+
+TEST(HedgingFilter, RetriesFailure) {
+  EventBase evb;
+  auto service = std::make_shared<ManualService>();
+  HedgingFilter<std::string> filter(service, HedgingOptions(), &evb);
+
+  auto f = filter("a");
+  service->promises[0].setException(std::runtime_error("failed"));
+  EXPECT_EQ(2, service->requests.size());
+  EXPECT_FALSE(f.isReady());
+
+  service->promises[1].setValue("retry");
+  EXPECT_EQ("retry", f.value());
+  EXPECT_EQ(1, filter.getStats().retries);
+  EXPECT_EQ(0, filter.getStats().hedgeWins);
+}
+
+TEST(ExecutorFilter, ElidesHopOnExecutor) {
+  auto exe = std::make_shared<ManualExecutor>();
+  auto service = std::make_shared<ManualService>();
+  ExecutorFilter<std::string> filter(exe, service);
+
+  // A service that makes a nested request through the filter
+  struct NestedService : public StringService {
+    Future<std::string> operator()(std::string req) override {
+      return (*filter)(req + "!");
+    }
+    ExecutorFilter<std::string>* filter;
+  };
+  auto nested = std::make_shared<NestedService>();
+  ExecutorFilter<std::string> outer(exe, nested);
+  nested->filter = &filter;
+
+  auto f = outer("a");
+  EXPECT_EQ(1, exe->run());
+  EXPECT_EQ(std::vector<std::string>({"a!"}), service->requests);
+  service->promises[0].setValue("b");
+  EXPECT_EQ("b", f.value());
+}
+
+TEST(ExecutorFilter, BatchesSameLoop) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  auto exe = std::make_shared<ManualExecutor>();
+  auto service = std::make_shared<EchoService>();
+  ExecutorFilter<std::string> filter(
+    {exe}, service, nullptr, nullptr, true, 2);
+
+  std::vector<Future<std::string>> futures;
+  evb->runInEventBaseThread([&] {
+    for (auto req : {"a", "b", "c"}) {
+      futures.push_back(filter(req));
+    }
+  });
+  evb->loop();
+  // Batches of at most two
+  EXPECT_EQ(2, exe->run());
+  EXPECT_EQ("a", futures[0].value());
+  EXPECT_EQ("c", futures[2].value());
+}
+
+TEST(ExecutorFilter, NoBatchingByDefault) {
+  auto evb = EventBaseManager::get()->getEventBase();
+  auto exe = std::make_shared<ManualExecutor>();
+  auto service = std::make_shared<EchoService>();
+  ExecutorFilter<std::string> filter(exe, service);
+
+  std::vector<Future<std::string>> futures;
+  evb->runInEventBaseThread([&] {
+    for (auto req : {"a", "b", "c"}) {
+      futures.push_back(filter(req));
+    }
+  });
+  evb->loop();
+  EXPECT_EQ(3, exe->run());
+  EXPECT_EQ("b", futures[1].value());
+}
+
+TEST(ExecutorFilter, Affinity) {
+  auto exe1 = std::make_shared<ManualExecutor>();
+  auto exe2 = std::make_shared<ManualExecutor>();
+  auto service = std::make_shared<EchoService>();
+  ExecutorFilter<std::string> filter(
+    {exe1, exe2}, service, [](const std::string& req) {
+      return uint64_t(req[0] == 'b');
+    });
+
+  auto f1 = filter("a1");
+  auto f2 = filter("b1");
+  auto f3 = filter("a2");
+  EXPECT_EQ(2, exe1->run());
+  EXPECT_EQ(1, exe2->run());
+  EXPECT_EQ("a2", f3.value());
+}
+
+TEST(DeadlineFilter, PropagatesBudget) {
+  // Responds with the time left before the request's deadline
+  struct RemainingService : public StringService {
+    Future<std::string> operator()(std::string) override {
+      auto remaining = Deadline::remaining();
+      return remaining ? folly::to<std::string>(remaining->count()) : "none";
+    }
+  };
+  auto service = std::make_shared<RemainingService>();
+  std::chrono::milliseconds forwarded{0};
+  DeadlineFilter<std::string> filter(
+    service,
+    std::chrono::seconds(10),
+    [](const std::string& req) -> Optional<std::chrono::milliseconds> {
+      if (req.empty()) {
+        return none;
+      }
+      return std::chrono::milliseconds(folly::to<int64_t>(req));
+    },
+    [&](std::string&, std::chrono::milliseconds budget) {
+      forwarded = budget;
+    });
+
+  EXPECT_LE(folly::to<int64_t>(filter("").value()), 10000);
+  EXPECT_GT(forwarded.count(), 9000);
+
+  // The client's budget is shorter than the timeout
+  EXPECT_LE(folly::to<int64_t>(filter("500").value()), 500);
+  EXPECT_GT(forwarded.count(), 400);
+  EXPECT_LE(forwarded.count(), 500);
+
+  EXPECT_TRUE(filter("0").getTry().hasException<DeadlineExceeded>());
+  EXPECT_FALSE(Deadline::get());
+}
+
+TEST(DeadlineFilter, DropsExpiredQueuedWork) {
+  auto exe = std::make_shared<ManualExecutor>();
+  auto service = std::make_shared<ManualService>();
+  auto executorFilter =
+    std::make_shared<ExecutorFilter<std::string>>(exe, service);
+  DeadlineFilter<std::string> shortDeadline(
+    executorFilter, std::chrono::milliseconds(1));
+  DeadlineFilter<std::string> longDeadline(
+    executorFilter, std::chrono::hours(1));
+
+  // Sleeping only ever lengthens the wait past the short deadline
+  auto f1 = shortDeadline("a");
+  auto f2 = longDeadline("b");
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(2, exe->run());
+  EXPECT_TRUE(f1.getTry().hasException<DeadlineExceeded>());
+  EXPECT_EQ(std::vector<std::string>({"b"}), service->requests);
+}
+
+TEST(QueueingFilter, Priorities) {
+  auto service = std::make_shared<ManualService>();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  options.numPriorities = 2;
+  QueueingFilter<std::string> filter(
+    service, options, [](const std::string& req) -> size_t {
+      return req[0] == 'h' ? 0 : 1;
+    });
+
+  auto f1 = filter("a");
+  auto f2 = filter("low");
+  auto f3 = filter("high");
+  EXPECT_EQ(1, filter.getInFlight());
+  EXPECT_EQ(2, filter.getQueued());
+
+  service->promises[0].setValue("a");
+  EXPECT_EQ("a", f1.value());
+  EXPECT_EQ(std::vector<std::string>({"a", "high"}), service->requests);
+  service->promises[1].setValue("high");
+  EXPECT_EQ("high", f3.value());
+  EXPECT_EQ("low", service->requests[2]);
+}
+
+TEST(QueueingFilter, RejectsWhenFull) {
+  auto service = std::make_shared<ManualService>();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  options.maxQueueSize = 1;
+  QueueingFilter<std::string> filter(service, options);
+
+  auto f1 = filter("a");
+  auto f2 = filter("b");
+  EXPECT_FALSE(filter.isAvailable());
+  EXPECT_TRUE(filter("c").getTry().hasException<QueueOverloaded>());
+  EXPECT_EQ(1, filter.getRejected());
+}
+
+TEST(QueueingFilter, ShedsWhenOverloaded) {
+  auto service = std::make_shared<ManualService>();
+  auto now = std::chrono::steady_clock::now();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  options.target = std::chrono::milliseconds(5);
+  options.interval = std::chrono::milliseconds(100);
+  options.clock = [&] { return now; };
+  QueueingFilter<std::string> filter(service, options);
+
+  auto a = filter("a");
+  auto b = filter("b");
+  now += std::chrono::milliseconds(200);
+  service->promises[0].setValue("a");
+  EXPECT_FALSE(filter.isOverloaded());
+  EXPECT_EQ("b", service->requests[1]);
+
+  // b waited well past target for an interval, so the next interval is
+  // overloaded: stale requests are shed and the newest goes first
+  auto c = filter("c");
+  now += std::chrono::milliseconds(200);
+  auto e = filter("e");
+  auto f = filter("f");
+  service->promises[1].setValue("b");
+  EXPECT_TRUE(filter.isOverloaded());
+  EXPECT_TRUE(c.getTry().hasException<QueueOverloaded>());
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "f"}), service->requests);
+  EXPECT_EQ(1, filter.getQueued());
+}
+
+TEST(QueueingFilter, DrainsReadyResponsesWithoutRecursion) {
+  // Holds the first request, and answers the rest at once
+  struct HoldFirstService : public StringService {
+    Future<std::string> operator()(std::string req) override {
+      if (!held) {
+        held = true;
+        return promise.getFuture();
+      }
+      answered++;
+      return req;
+    }
+
+    bool held{false};
+    Promise<std::string> promise;
+    size_t answered{0};
+  };
+  auto service = std::make_shared<HoldFirstService>();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  options.maxQueueSize = 100000;
+  QueueingFilter<std::string> filter(service, options);
+
+  auto first = filter("first");
+  std::vector<Future<std::string>> queued;
+  for (size_t i = 0; i < options.maxQueueSize; i++) {
+    queued.push_back(filter("queued"));
+  }
+  service->promise.setValue("first");
+  EXPECT_EQ(options.maxQueueSize, service->answered);
+  EXPECT_EQ("queued", queued.back().value());
+  EXPECT_EQ(0, filter.getInFlight());
+  EXPECT_EQ(0, filter.getQueued());
+}
+
+TEST(QueueingFilter, OutlivedByRequests) {
+  auto service = std::make_shared<ManualService>();
+  QueueingOptions options;
+  options.maxInFlight = 1;
+  auto filter = std::make_unique<QueueingFilter<std::string>>(service, options);
+
+  auto f1 = (*filter)("a");
+  auto f2 = (*filter)("b");
+  filter.reset();
+  service->promises[0].setValue("a");
+  service->promises[1].setValue("b");
+  EXPECT_EQ("a", f1.value());
+  EXPECT_EQ("b", f2.value());
+}
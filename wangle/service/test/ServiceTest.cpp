@@ -22,7 +22,6 @@
 #include <wangle/service/ServerDispatcher.h>
 #include <wangle/service/Service.h>
 #include <wangle/service/CloseOnReleaseFilter.h>
-#include <wangle/service/ExpiringFilter.h>
 
 namespace wangle {
 
@@ -255,79 +254,4 @@ TEST(Wangle, FactoryToService) {
   EXPECT_EQ("test", service("test").value());
 }
 
-class TimekeeperTester : public Timekeeper {
- public:
-  Future<Unit> after(Duration) override {
-    Promise<Unit> p;
-    auto f = p.getFuture();
-    promises_.push_back(std::move(p));
-    return f;
-  }
-  template <class Clock>
-  Future<Unit> at(std::chrono::time_point<Clock>) {
-    Promise<Unit> p;
-    auto f = p.getFuture();
-    promises_.push_back(std::move(p));
-    return f;
-  }
-  std::vector<Promise<Unit>> promises_;
-};
-
-TEST(ServiceFilter, ExpiringMax) {
-  TimekeeperTester timekeeper;
-
-  std::shared_ptr<Service<std::string, std::string>> service =
-    std::make_shared<EchoService>();
-  std::shared_ptr<Service<std::string, std::string>> closeOnReleaseService =
-    std::make_shared<CloseOnReleaseFilter<std::string, std::string>>(service);
-  std::shared_ptr<Service<std::string, std::string>> expiringService =
-    std::make_shared<ExpiringFilter<std::string, std::string>>(
-      closeOnReleaseService,
-      std::chrono::milliseconds(0),
-      std::chrono::milliseconds(400),
-      &timekeeper);
-
-  EXPECT_EQ("test", (*expiringService)("test").get());
-  timekeeper.promises_[0].setValue();
-  EXPECT_TRUE((*expiringService)("test").getTry().hasException());
-}
-
-TEST(ServiceFilter, ExpiringIdle) {
-  TimekeeperTester timekeeper;
-
-  std::shared_ptr<Service<std::string, std::string>> service =
-    std::make_shared<EchoService>();
-  std::shared_ptr<Service<std::string, std::string>> closeOnReleaseService =
-    std::make_shared<CloseOnReleaseFilter<std::string, std::string>>(service);
-  std::shared_ptr<Service<std::string, std::string>> expiringService =
-    std::make_shared<ExpiringFilter<std::string, std::string>>(
-      closeOnReleaseService,
-      std::chrono::milliseconds(100),
-      std::chrono::milliseconds(0),
-      &timekeeper);
-
-  EXPECT_EQ(1, timekeeper.promises_.size());
-}
-
-TEST(ServiceFilter, NoIdleDuringRequests) {
-  TimekeeperTester timekeeper;
-
-  std::shared_ptr<Service<std::string, std::string>> service =
-    std::make_shared<EchoService>();
-  std::shared_ptr<Service<std::string, std::string>> closeOnReleaseService =
-    std::make_shared<CloseOnReleaseFilter<std::string, std::string>>(service);
-  std::shared_ptr<Service<std::string, std::string>> expiringService =
-    std::make_shared<ExpiringFilter<std::string, std::string>>(
-      closeOnReleaseService,
-      std::chrono::milliseconds(1),
-      std::chrono::milliseconds(0),
-      &timekeeper);
-
-  auto f = (*expiringService)("2000");
-  EXPECT_EQ(2, timekeeper.promises_.size());
-  std::move(f).get();
-  EXPECT_EQ("2000", (*expiringService)("2000").get());
-  EXPECT_EQ(3, timekeeper.promises_.size());
-}
-
 } // namespace wangle